@@ -52,6 +52,9 @@ Actions::Actions(QObject *parent) : QObject(parent)
     operationGhostMode = new QAction("Ghost Mode", this);
     operationGhostMode->setCheckable(true);
     operationGhostMode->setChecked(true);
+    operationCancel = new QAction("Cancel", this);
+    operationCancel->setShortcut(QKeySequence(Qt::Key_Escape));
+    operationCancel->setEnabled(false);
 }
 
 } // namespace BooleanOffset
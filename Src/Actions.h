@@ -32,6 +32,7 @@ public:
     QAction *operationOffsetIn;
     QAction *operationReload;
     QAction *operationGhostMode;
+    QAction *operationCancel;
 
 };
 
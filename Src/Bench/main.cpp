@@ -0,0 +1,330 @@
+#include "../Engine/arc.h"
+#include "../Engine/arena.h"
+#include "../Engine/boolean.h"
+#include "../Engine/global.h"
+#include "../Engine/line.h"
+#include "../Engine/shape.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+typedef std::chrono::steady_clock CLOCK;
+
+struct OPTIONS
+{
+    int maxPrims;
+    double budget;
+    const char *filter;
+};
+
+struct SAMPLE
+{
+    int size;
+    long long reps;
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+// Results land here so the optimizer cannot drop the calls being timed.
+static volatile double sink;
+
+static double secondsSince(CLOCK::time_point start)
+{
+    return std::chrono::duration<double>(CLOCK::now() - start).count();
+}
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+        "usage: %s [-m max-prims] [-t seconds] [filter]\n"
+        "\n"
+        "  -m  largest shape to build, 10 to 100000 (default 100000)\n"
+        "  -t  time spent on each measurement (default 0.5)\n"
+        "  filter runs only the benchmarks whose name contains it\n",
+        program);
+}
+
+// Calls op(n) with growing n until one batch takes the whole budget; for
+// calls far shorter than the clock resolution.
+template <class OP>
+static SAMPLE measureBatch(OP op, double budget)
+{
+    SAMPLE s;
+    long long n = 1;
+
+    while (true) {
+        unsigned long long allocs = GetAllocationCount();
+        CLOCK::time_point start = CLOCK::now();
+        op(n);
+        double t = secondsSince(start);
+        if (t >= budget || n >= (1LL << 40)) {
+            s.reps = n;
+            s.nsPerOp = t * 1E9 / n;
+            s.allocsPerOp = (double)(GetAllocationCount() - allocs) / n;
+            return s;
+        }
+        n = t > budget / 100 ? (long long)(n * budget / t) + 1 : n * 10;
+    }
+}
+
+// Times op() alone, one call at a time, with setup() run before each call
+// and left out of both the time and the allocation count.
+template <class SETUP, class OP>
+static SAMPLE measureEach(SETUP setup, OP op, double budget)
+{
+    SAMPLE s;
+    double total = 0;
+    unsigned long long allocs = 0;
+
+    s.reps = 0;
+    while (s.reps == 0 || total < budget) {
+        setup();
+        unsigned long long a = GetAllocationCount();
+        CLOCK::time_point start = CLOCK::now();
+        op();
+        total += secondsSince(start);
+        allocs += GetAllocationCount() - a;
+        s.reps++;
+    }
+    s.nsPerOp = total * 1E9 / s.reps;
+    s.allocsPerOp = (double)allocs / s.reps;
+    return s;
+}
+
+static void printHeader()
+{
+    printf("%-36s %8s %10s %14s %10s\n", "benchmark", "prims", "reps", "ns/op", "allocs/op");
+}
+
+static void printSample(const char *name, const SAMPLE &s)
+{
+    printf("%-36s %8d %10lld %14.1f %10.1f\n", name, s.size, s.reps, s.nsPerOp, s.allocsPerOp);
+    fflush(stdout);
+}
+
+// Least squares slope of log(ns/op) over log(prims): 1 is linear, 2 is
+// quadratic.
+static void printExponent(const std::vector<SAMPLE> &samples)
+{
+    if (samples.size() < 2) return;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    double n = (double)samples.size();
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        double x = log((double)samples[i].size);
+        double y = log(samples[i].nsPerOp);
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+    printf("%-36s %8s %10s %14s %10s  scaling exponent %.2f\n", "", "", "", "", "",
+        (n * sxy - sx * sy) / (n * sxx - sx * sx));
+}
+
+static bool isSelected(const OPTIONS &options, const char *name)
+{
+    return options.filter == NULL || strstr(name, options.filter) != NULL;
+}
+
+// A star with n edges alternating between two radii, so neighbouring edges
+// never come close to collinear however large n gets. The radius grows with
+// n so the edges stay a few units long at every size.
+static void makeStar(int n, double cx, SHAPE *shp)
+{
+    const double r1 = n, r2 = n - 2;
+    std::vector<TERMINAL> pts;
+    for (int i = 0; i < n; i++) {
+        double a = 2 * M_PI * i / n;
+        double r = i % 2 == 0 ? r1 : r2;
+        pts.push_back(TERMINAL(cx + r * cos(a), r * sin(a)));
+    }
+    shp->clear();
+    for (int i = 0; i < n; i++) {
+        shp->prims.push_back(std::make_unique<LINE>(pts[i], pts[(i + 1) % n]));
+    }
+    shp->update();
+}
+
+// A circle of n points joined alternately by chords and by half circles
+// bulging inwards, so half of the primitives are arcs.
+static void makeScallop(int n, SHAPE *shp)
+{
+    const double r = n;
+    std::vector<TERMINAL> pts;
+    for (int i = 0; i < n; i++) {
+        double a = 2 * M_PI * i / n;
+        pts.push_back(TERMINAL(r * cos(a), r * sin(a)));
+    }
+    shp->clear();
+    for (int i = 0; i < n; i++) {
+        const TERMINAL &p1 = pts[i];
+        const TERMINAL &p2 = pts[(i + 1) % n];
+        if (i % 2 == 0) {
+            shp->prims.push_back(std::make_unique<LINE>(p1, p2));
+        }
+        else {
+            TERMINAL c = TERMINAL((p1.x + p2.x) / 2, (p1.y + p2.y) / 2);
+            shp->prims.push_back(std::make_unique<ARC>(c, p1, p2, true));
+        }
+    }
+    shp->update();
+}
+
+// Overlapping stars of ten edges each in a row, at least two of them, for
+// the boolean driver. Returns the number of edges.
+static int makeRow(int n, std::vector<SHAPE> *shapes)
+{
+    int count = n / 10 < 2 ? 2 : n / 10;
+    shapes->clear();
+    shapes->resize(count);
+    for (int i = 0; i < count; i++) {
+        makeStar(10, 15.0 * i, &shapes->at(i));
+    }
+    return count * 10;
+}
+
+static void benchPairs(const OPTIONS &options)
+{
+    LINE l1(TERMINAL(-10.0, -1.0), TERMINAL(10.0, 1.0));
+    LINE l2(TERMINAL(-10.0, 1.0), TERMINAL(10.0, -1.0));
+    ARC a1(TERMINAL(0.0, 0.0), 5.0, 200.0, 340.0, false);
+    ARC a2(TERMINAL(3.0, -2.0), 5.0, 90.0, 270.0, false);
+    struct PAIR { const char *name; PRIMITIVE *p1; PRIMITIVE *p2; };
+    PAIR pairs[] = {
+        { "isConflict line/line", &l1, &l2 },
+        { "isConflict line/arc", &l1, &a1 },
+        { "isConflict arc/line", &a1, &l1 },
+        { "isConflict arc/arc", &a1, &a2 },
+    };
+
+    for (std::size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        if (!isSelected(options, pairs[i].name)) continue;
+        PRIMITIVE *p1 = pairs[i].p1;
+        PRIMITIVE *p2 = pairs[i].p2;
+        SAMPLE s = measureBatch([&](long long n) {
+            for (long long k = 0; k < n; k++) {
+                TERMINAL t1, t2;
+                sink = isConflict(p1, p2, &t1, &t2) + t1.x;
+            }
+        }, options.budget);
+        s.size = 2;
+        printSample(pairs[i].name, s);
+    }
+
+    const char *name = "ARC::isContainedPoint";
+    if (isSelected(options, name)) {
+        TERMINAL pts[8];
+        for (int k = 0; k < 8; k++) {
+            double a = 45.0 * k + 10.0;
+            pts[k] = TERMINAL(5.0 * cos(a * M_PI / 180.0), 5.0 * sin(a * M_PI / 180.0));
+        }
+        SAMPLE s = measureBatch([&](long long n) {
+            int hits = 0;
+            for (long long k = 0; k < n; k++) {
+                hits += a1.isContainedPoint(pts[k & 7]) ? 1 : 0;
+            }
+            sink = hits;
+        }, options.budget);
+        s.size = 1;
+        printSample(name, s);
+    }
+}
+
+// Runs one shape operation over growing shapes until the largest size or a
+// single call takes longer than the whole budget. make(n) builds the input
+// and returns its actual number of primitives.
+template <class MAKE, class SETUP, class OP>
+static void benchSeries(const OPTIONS &options, const char *name, MAKE make, SETUP setup, OP op)
+{
+    if (!isSelected(options, name)) return;
+    std::vector<SAMPLE> samples;
+    for (int n = 10; n <= options.maxPrims; n *= 10) {
+        int size = make(n);
+        SAMPLE s = measureEach(setup, op, options.budget);
+        s.size = size;
+        printSample(name, s);
+        samples.push_back(s);
+        if (s.reps == 1 && s.nsPerOp > options.budget * 1E9) break;
+    }
+    printExponent(samples);
+}
+
+static void benchShapes(const OPTIONS &options)
+{
+    SHAPE source;
+    SHAPE work;
+    std::vector<SHAPE> subShapes;
+    ARENA arena;
+
+    benchSeries(options, "SHAPE::update star",
+        [&](int n) { makeStar(n, 0, &source); return n; },
+        [&]() { work = source; },
+        [&]() { work.update(); });
+    benchSeries(options, "SHAPE::update scallop",
+        [&](int n) { makeScallop(n, &source); return n; },
+        [&]() { work = source; },
+        [&]() { work.update(); });
+    benchSeries(options, "SHAPE::isPositiveShape star",
+        [&](int n) { makeStar(n, 0, &source); return n; },
+        [&]() { work = source; },
+        [&]() { sink = work.isPositiveShape(); });
+    benchSeries(options, "SHAPE::isPositiveShape scallop",
+        [&](int n) { makeScallop(n, &source); return n; },
+        [&]() { work = source; },
+        [&]() { sink = work.isPositiveShape(); });
+    benchSeries(options, "SHAPE::doOffsetOperation star",
+        [&](int n) { makeStar(n, 0, &source); return n; },
+        [&]() { work = source; subShapes.clear(); },
+        [&]() { work.doOffsetOperation(1.0, &subShapes, &arena); });
+    benchSeries(options, "SHAPE::doOffsetOperation scallop",
+        [&](int n) { makeScallop(n, &source); return n; },
+        [&]() { work = source; subShapes.clear(); },
+        [&]() { work.doOffsetOperation(1.0, &subShapes, &arena); });
+}
+
+static void benchBoolean(const OPTIONS &options)
+{
+    std::vector<SHAPE> source;
+    std::vector<SHAPE> work;
+    BOOLEANENGINE engine;
+
+    benchSeries(options, "BOOLEANENGINE::execute row",
+        [&](int n) { return makeRow(n, &source); },
+        [&]() { work = source; },
+        [&]() { engine.execute(&work); });
+}
+
+int main(int argc, char *argv[])
+{
+    OPTIONS options;
+    options.maxPrims = 100000;
+    options.budget = 0.5;
+    options.filter = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            options.maxPrims = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            options.budget = atof(argv[++i]);
+        }
+        else if (argv[i][0] == '-') {
+            printUsage(argv[0]);
+            return argv[i][1] == 'h' ? 0 : 1;
+        }
+        else {
+            options.filter = argv[i];
+        }
+    }
+    if (options.maxPrims < 10 || options.budget <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    printHeader();
+    benchPairs(options);
+    benchShapes(options);
+    benchBoolean(options);
+    return 0;
+}
@@ -0,0 +1,328 @@
+#include "../Engine/boolean.h"
+#include "../Engine/budget.h"
+#include "../Engine/offset.h"
+#include "../Engine/shape.h"
+#include "../Engine/shapefile.h"
+#include "../Engine/threadpool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum _OPERATION_KIND_
+{
+    OPERATION_OFFSET = 1,
+    OPERATION_BOOLEAN = 2,
+    OPERATION_RINGS = 3
+};
+
+struct OPERATION
+{
+    int nKind;
+    double value;
+    int count;
+};
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+        "usage: %s [-j threads] [-t seconds] [-i iterations] [-f version] [-q grid] [-p] [-s script] <input> <output> [operation ...]\n"
+        "\n"
+        "  -j  worker threads, 0 for one per core (default 0)\n"
+        "  -t  give up after this many seconds (default none)\n"
+        "  -i  give up after this many steps of the trimming walks (default none)\n"
+        "      a run that gives up writes nothing and exits with status 3\n"
+        "  -f  output file version, 1 for the legacy layout, 3 for the compact\n"
+        "      one (default 2); any version is read\n"
+        "  -q  grid the compact layout snaps coordinates to (default 1e-6)\n"
+        "  -p  stream the shapes through one at a time, each on its own, so\n"
+        "      memory stays flat however large the file; no boolean\n"
+        "\n"
+        "operations, applied in order:\n"
+        "  offset <distance>   offset every shape, positive grows\n"
+        "  boolean             merge overlapping shapes\n"
+        "  rings <stride> <n>  replace the shapes with the rings offset by\n"
+        "                      stride, 2 * stride, ... n * stride, in order\n"
+        "\n"
+        "a script holds the same operations, one per line; '#' starts a comment.\n",
+        program);
+}
+
+static bool parseDouble(const char *text, double *ret)
+{
+    char *end = NULL;
+    *ret = strtod(text, &end);
+    return end != text && *end == '\0';
+}
+
+static bool parseInt(const char *text, int *ret)
+{
+    char *end = NULL;
+    *ret = (int)strtol(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+static bool parseInt64(const char *text, std::int64_t *ret)
+{
+    char *end = NULL;
+    *ret = (std::int64_t)strtoll(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+// Consumes one operation from words[*index], advancing past its arguments.
+static bool parseOperation(const std::vector<std::string> &words, std::size_t *index, std::vector<OPERATION> *ops)
+{
+    const std::string &word = words[*index];
+    OPERATION op;
+
+    if (word == "offset") {
+        if (*index + 1 >= words.size() || !parseDouble(words[*index + 1].c_str(), &op.value)) {
+            fprintf(stderr, "offset needs a distance\n");
+            return false;
+        }
+        op.nKind = OPERATION_OFFSET;
+        op.count = 0;
+        *index += 2;
+    }
+    else if (word == "boolean") {
+        op.nKind = OPERATION_BOOLEAN;
+        op.value = 0;
+        op.count = 0;
+        *index += 1;
+    }
+    else if (word == "rings") {
+        if (*index + 2 >= words.size() || !parseDouble(words[*index + 1].c_str(), &op.value)
+            || !parseInt(words[*index + 2].c_str(), &op.count) || op.count < 1) {
+            fprintf(stderr, "rings needs a stride and a ring count\n");
+            return false;
+        }
+        op.nKind = OPERATION_RINGS;
+        *index += 3;
+    }
+    else {
+        fprintf(stderr, "unknown operation '%s'\n", word.c_str());
+        return false;
+    }
+    ops->push_back(op);
+    return true;
+}
+
+static bool parseWords(const std::vector<std::string> &words, std::vector<OPERATION> *ops)
+{
+    std::size_t i = 0;
+    while (i < words.size()) {
+        if (!parseOperation(words, &i, ops)) return false;
+    }
+    return true;
+}
+
+static bool readScript(const char *filePath, std::vector<OPERATION> *ops)
+{
+    FILE *pFile = fopen(filePath, "r");
+    if (pFile == NULL) {
+        fprintf(stderr, "cannot open script '%s'\n", filePath);
+        return false;
+    }
+    std::vector<std::string> words;
+    char line[1024];
+    while (fgets(line, sizeof(line), pFile) != NULL) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+        for (char *tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+            words.push_back(tok);
+        }
+    }
+    fclose(pFile);
+    return parseWords(words, ops);
+}
+
+static int runOperation(const OPERATION &op, BUDGET *budget, std::vector<SHAPE> *shapes)
+{
+    switch (op.nKind)
+    {
+    case OPERATION_OFFSET:
+        return OffsetShapes(shapes, op.value, [](double, double) { return true; }, budget);
+    case OPERATION_BOOLEAN:
+        {
+            BOOLEANENGINE engine;
+            engine.setBudget(budget);
+            engine.execute(shapes);
+        }
+        break;
+    case OPERATION_RINGS:
+        {
+            std::vector<std::vector<SHAPE>> rings;
+            int status = OffsetRings(*shapes, op.value, op.count, &rings, budget);
+            if (status != BUDGET_OK) return status;
+            shapes->clear();
+            for (std::size_t i = 0; i < rings.size(); i++) {
+                for (std::size_t j = 0; j < rings[i].size(); j++) {
+                    shapes->push_back(std::move(rings[i][j]));
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return budget->getStatus();
+}
+
+// Reads, runs and writes a few shapes at a time, one per worker, so at
+// most that many shapes are in memory. Each shape goes through the
+// operations alone, which leaves out anything that merges shapes.
+static int runStreamed(const char *input, const char *output, int version, double grid, const std::vector<OPERATION> &ops, BUDGET *budget)
+{
+    SHAPEREADER reader;
+    SHAPEWRITER writer;
+    if (!reader.open(input)) {
+        fprintf(stderr, "cannot read '%s'\n", input);
+        return 2;
+    }
+    if (!writer.open(output, version, grid)) {
+        fprintf(stderr, "cannot write '%s'\n", output);
+        return 2;
+    }
+
+    std::vector<std::vector<SHAPE>> batch(GetThreadCount());
+    budget->start();
+    for (;;) {
+        int count = 0;
+        while (count < (int)batch.size()) {
+            batch[count].resize(1);
+            if (!reader.read(&batch[count][0])) break;
+            count++;
+        }
+        if (reader.isFailed()) {
+            fprintf(stderr, "cannot read '%s'\n", input);
+            return 2;
+        }
+        if (count == 0) break;
+
+        ParallelFor(count, [&](int i, int) {
+            for (std::size_t j = 0; j < ops.size(); j++) {
+                if (runOperation(ops[j], budget, &batch[i]) != BUDGET_OK) break;
+            }
+        });
+        if (budget->getStatus() != BUDGET_OK) {
+            fprintf(stderr, "gave up on '%s': over budget\n", input);
+            return 3;
+        }
+        for (int i = 0; i < count; i++) {
+            for (std::size_t j = 0; j < batch[i].size(); j++) {
+                if (!writer.write(batch[i][j])) break;
+            }
+            batch[i].clear();
+        }
+    }
+    if (!writer.close()) {
+        fprintf(stderr, "cannot write '%s'\n", output);
+        return 2;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<OPERATION> ops;
+    std::vector<std::string> words;
+    BUDGET budget;
+    int version = SHAPEFILE_V2;
+    double grid = SHAPEFILE_GRID;
+    bool streamed = false;
+    const char *input = NULL;
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            if (!readScript(argv[++i], &ops)) return 1;
+        }
+        else if (strcmp(argv[i], "-j") == 0) {
+            int threads = 0;
+            if (i + 1 >= argc || !parseInt(argv[++i], &threads) || threads < 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            SetThreadCount(threads);
+        }
+        else if (strcmp(argv[i], "-t") == 0) {
+            if (i + 1 >= argc || !parseDouble(argv[++i], &budget.seconds)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-i") == 0) {
+            if (i + 1 >= argc || !parseInt64(argv[++i], &budget.maxIterations) || budget.maxIterations < 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-f") == 0) {
+            if (i + 1 >= argc || !parseInt(argv[++i], &version)
+                || version < SHAPEFILE_LEGACY || version > SHAPEFILE_COMPACT) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            if (i + 1 >= argc || !parseDouble(argv[++i], &grid) || !(grid > 0)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0) {
+            streamed = true;
+        }
+        else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (input == NULL) {
+            input = argv[i];
+        }
+        else if (output == NULL) {
+            output = argv[i];
+        }
+        else {
+            words.push_back(argv[i]);
+        }
+    }
+    if (input == NULL || output == NULL) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (!parseWords(words, &ops)) return 1;
+    if (streamed) {
+        for (std::size_t i = 0; i < ops.size(); i++) {
+            if (ops[i].nKind == OPERATION_BOOLEAN) {
+                fprintf(stderr, "boolean merges shapes and cannot be streamed\n");
+                return 1;
+            }
+        }
+        return runStreamed(input, output, version, grid, ops, &budget);
+    }
+
+    std::vector<SHAPE> shapes;
+    if (!ReadShapeFile(input, &shapes)) {
+        fprintf(stderr, "cannot read '%s'\n", input);
+        return 2;
+    }
+    budget.start();
+    for (std::size_t i = 0; i < ops.size(); i++) {
+        if (runOperation(ops[i], &budget, &shapes) != BUDGET_OK) {
+            fprintf(stderr, "gave up on '%s': over budget\n", input);
+            return 3;
+        }
+    }
+    if (!WriteShapeFile(output, &shapes, version, grid)) {
+        fprintf(stderr, "cannot write '%s'\n", output);
+        return 2;
+    }
+    return 0;
+}
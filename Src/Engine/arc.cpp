@@ -1,8 +1,28 @@
 #include "arc.h"
 #include "global.h"
+#include "primvalue.h"
 
-#include <QTextStream>
 #include <math.h>
+#include <utility>
+
+// Sine of about 6e-5 degrees, ten times the EP_A tolerance either side.
+static const double CLEAR_MARGIN = 1E-6;
+
+// Unit vector from c towards p; straight down for p on c, the direction
+// angleTo() reports for it.
+static void GetUnit(const TERMINAL &c, const TERMINAL &p, double *ux, double *uy)
+{
+    double dx = p.x - c.x;
+    double dy = p.y - c.y;
+    double m = sqrt(dx * dx + dy * dy);
+    if (m == 0) {
+        *ux = 0;
+        *uy = -1;
+        return;
+    }
+    *ux = dx / m;
+    *uy = dy / m;
+}
 
 ARC::ARC() : PRIMITIVE() {
     this->nKind = GBAPY_ARC;
@@ -10,6 +30,11 @@ ARC::ARC() : PRIMITIVE() {
     this->startAngle = 0;
     this->endAngle = 0;
     this->clockWise = true;
+    // a point, which the convexity test finds convex, without libm calls
+    m_cache.cosStart = m_cache.cosEnd = 1;
+    m_cache.sinStart = m_cache.sinEnd = 0;
+    m_cache.sweepStart = m_cache.sweepEnd = 0;
+    m_cache.convex = true;
 }
 
 ARC::~ARC() = default;
@@ -25,6 +50,23 @@ ARC::ARC(TERMINAL c, TERMINAL t1, TERMINAL t2, bool cw) : PRIMITIVE() {
     this->terms[0] = t1;
     this->terms[1] = t2;
     this->clockWise = cw;
+
+    double ux1, uy1, ux2, uy2;
+    GetUnit(c, t1, &ux1, &uy1);
+    GetUnit(c, t2, &ux2, &uy2);
+    this->updateCache(ux1, uy1, ux2, uy2);
+}
+
+ARC::ARC(TERMINAL c, double r, TERMINAL t1, TERMINAL t2, bool cw) : PRIMITIVE() {
+    this->nKind = GBAPY_ARC;
+    this->center = c;
+    this->radius = r;
+    this->startAngle = center.angleTo(t1);
+    this->endAngle = center.angleTo(t2);
+    this->terms[0] = t1;
+    this->terms[1] = t2;
+    this->clockWise = cw;
+    this->updateCache((t1.x - c.x) / r, (t1.y - c.y) / r, (t2.x - c.x) / r, (t2.y - c.y) / r);
 }
 
 ARC::ARC(TERMINAL c, double r, double sa, double ea, bool cw) : PRIMITIVE() {
@@ -33,9 +75,14 @@ ARC::ARC(TERMINAL c, double r, double sa, double ea, bool cw) : PRIMITIVE() {
     radius = r;
     startAngle = sa;
     endAngle = ea;
-    terms[0] = TERMINAL(c.x + r * cos(sa * M_PI / 180.0f), c.y + r * sin(sa * M_PI / 180.0f));
-    terms[1] = TERMINAL(c.x + r * cos(ea * M_PI / 180.0f), c.y + r * sin(ea * M_PI / 180.0f));
     clockWise = cw;
+    double cosStart = cos(sa * M_PI / 180.0f);
+    double sinStart = sin(sa * M_PI / 180.0f);
+    double cosEnd = cos(ea * M_PI / 180.0f);
+    double sinEnd = sin(ea * M_PI / 180.0f);
+    terms[0] = TERMINAL(c.x + r * cosStart, c.y + r * sinStart);
+    terms[1] = TERMINAL(c.x + r * cosEnd, c.y + r * sinEnd);
+    updateCache(cosStart, sinStart, cosEnd, sinEnd);
 }
 
 ARC::ARC(TERMINAL c, double r, double sa, double ea, TERMINAL t1, TERMINAL t2, bool cw) : PRIMITIVE() {
@@ -47,6 +94,40 @@ ARC::ARC(TERMINAL c, double r, double sa, double ea, TERMINAL t1, TERMINAL t2, b
     terms[0] = t1;
     terms[1] = t2;
     clockWise = cw;
+    updateCache();
+}
+
+void ARC::updateCache()
+{
+    this->updateCache(cos(startAngle * M_PI / 180.0f), sin(startAngle * M_PI / 180.0f),
+        cos(endAngle * M_PI / 180.0f), sin(endAngle * M_PI / 180.0f));
+}
+
+// Callers that already know the unit vectors of both ends pass them in
+// rather than have them worked out again from the angles.
+void ARC::updateCache(double cosStart, double sinStart, double cosEnd, double sinEnd)
+{
+    double sa = startAngle;
+    double ea = endAngle;
+
+    m_cache.cosStart = cosStart;
+    m_cache.sinStart = sinStart;
+    m_cache.cosEnd = cosEnd;
+    m_cache.sinEnd = sinEnd;
+    this->makeAbsoluteAngles(&sa, &ea);
+    m_cache.sweepStart = sa;
+    m_cache.sweepEnd = ea;
+
+    // the start point turns clockwise or counter-clockwise to a tenth of
+    // the sweep, seen from the center
+    double angle = sa + (ea - sa) / 10.0f;
+    VERTEX v1 = VERTEX(center.x + radius * cos(angle * M_PI / 180.0f),
+        center.y + radius * sin(angle * M_PI / 180.0f), 0.0f);
+    VERTEX v2 = VERTEX(terms[0].x, terms[0].y, 0);
+    v1.x -= v2.x; v1.y -= v2.y;
+    v2.x = center.x - v2.x; v2.y = center.y - v2.y;
+    v1 = v2.crossProduct(v1);
+    m_cache.convex = !(v1.z > 0);
 }
 
 bool ARC::isFlipped() {
@@ -67,42 +148,108 @@ void ARC::makeAbsoluteAngles(double *sa, double *ea) const {
 std::unique_ptr<PRIMITIVE> ARC::clone() const
 {
     std::unique_ptr<ARC> prim = std::make_unique<ARC>();
-    prim->center = this->center;
-    prim->radius = this->radius;
-    prim->startAngle = this->startAngle;
-    prim->endAngle = this->endAngle;
-    prim->clockWise = this->clockWise;
-    prim->terms[0] = this->terms[0];
-    prim->terms[1] = this->terms[1];
-
+    this->getCopy(prim.get());
     return prim;
 }
 
 std::unique_ptr<PRIMITIVE> ARC::clone(const TERMINAL &p) const
 {
-	if (this->isContainedPoint(p) == false) return NULL;
+    ARC ret;
+    if (!this->getClone(p, &ret)) return NULL;
+    return std::make_unique<ARC>(ret);
+}
+
+std::unique_ptr<PRIMITIVE> ARC::clone(const TERMINAL &p1, const TERMINAL &p2) const
+{
+    ARC ret;
+    if (!this->getClone(p1, p2, &ret)) return NULL;
+    return std::make_unique<ARC>(ret);
+}
+
+PRIMITIVE *ARC::clone(ARENA *arena) const
+{
+    ARC *prim = arena->create<ARC>();
+    this->getCopy(prim);
+    return prim;
+}
+
+PRIMITIVE *ARC::clone(const TERMINAL &p, ARENA *arena) const
+{
+    ARC ret;
+    if (!this->getClone(p, &ret)) return NULL;
+    return arena->create<ARC>(ret);
+}
+
+PRIMITIVE *ARC::clone(const TERMINAL &p1, const TERMINAL &p2, ARENA *arena) const
+{
+    ARC ret;
+    if (!this->getClone(p1, p2, &ret)) return NULL;
+    return arena->create<ARC>(ret);
+}
+
+PRIMVALUE ARC::cloneValue() const
+{
+    ARC ret;
+    this->getCopy(&ret);
+    return PRIMVALUE(ret);
+}
+
+void ARC::getCopy(ARC *ret) const
+{
+    ret->center = this->center;
+    ret->radius = this->radius;
+    ret->startAngle = this->startAngle;
+    ret->endAngle = this->endAngle;
+    ret->clockWise = this->clockWise;
+    ret->terms[0] = this->terms[0];
+    ret->terms[1] = this->terms[1];
+    ret->m_cache = this->m_cache;
+}
+
+PRIMVALUE ARC::cloneValue(const TERMINAL &p) const
+{
+    ARC ret;
+    if (!this->getClone(p, &ret)) return PRIMVALUE();
+    return PRIMVALUE(ret);
+}
+
+PRIMVALUE ARC::cloneValue(const TERMINAL &p1, const TERMINAL &p2) const
+{
+    ARC ret;
+    if (!this->getClone(p1, p2, &ret)) return PRIMVALUE();
+    return PRIMVALUE(ret);
+}
+
+bool ARC::getClone(const TERMINAL &p, ARC *ret) const
+{
+	if (this->isContainedPoint(p) == false) return false;
     double sa = this->center.angleTo(p);
     double ea = this->endAngle;
-	if (std::abs(sa - ea) <= EP_A) return NULL;
+    double ux = m_cache.cosStart;
+    double uy = m_cache.sinStart;
+	if (std::abs(sa - ea) <= EP_A) return false;
 	if (std::abs(this->startAngle - sa) <= EP_A) sa = this->startAngle;
-    std::unique_ptr<ARC> prim = std::make_unique<ARC>();
-    prim->center = this->center;
-    prim->radius = this->radius;
-    prim->clockWise = this->clockWise;
-    prim->startAngle = sa;
-    prim->endAngle = ea;
-    prim->terms[0].x = p.x; prim->terms[0].y = p.y;
-    prim->terms[1] = this->terms[1];
+    else GetUnit(this->center, p, &ux, &uy);
+    ret->center = this->center;
+    ret->radius = this->radius;
+    ret->clockWise = this->clockWise;
+    ret->startAngle = sa;
+    ret->endAngle = ea;
+    ret->terms[0].x = p.x; ret->terms[0].y = p.y;
+    ret->terms[1] = this->terms[1];
+    ret->updateCache(ux, uy, m_cache.cosEnd, m_cache.sinEnd);
 
-    return prim;
+    return true;
 }
 
-std::unique_ptr<PRIMITIVE> ARC::clone(const TERMINAL &p1, const TERMINAL &p2) const
+bool ARC::getClone(const TERMINAL &p1, const TERMINAL &p2, ARC *ret) const
 {
-	if (this->isContainedPoint(p1) == false) return NULL;
-	if (this->isContainedPoint(p2) == false) return NULL;
-    double sa = this->center.angleTo(p1);
-    double ea = this->center.angleTo(p2);
+	if (this->isContainedPoint(p1) == false) return false;
+	if (this->isContainedPoint(p2) == false) return false;
+    const double a1 = this->center.angleTo(p1);
+    const double a2 = this->center.angleTo(p2);
+    double sa = a1;
+    double ea = a2;
 	double ssa = this->startAngle;
 	double eea = this->endAngle;
 	if (std::abs(ssa - sa) <= EP_A) sa = ssa;
@@ -113,28 +260,30 @@ std::unique_ptr<PRIMITIVE> ARC::clone(const TERMINAL &p1, const TERMINAL &p2) co
     this->makeAbsoluteAngles(&sa, &ea);
 	this->makeAbsoluteAngles(&ssa, &eea);
 
-    if (std::abs(ea - sa) <= EP_A) return NULL;
-	if (ssa > eea && sa < ea) return NULL;
-	if (ssa < eea && sa > ea) return NULL;
+    if (std::abs(ea - sa) <= EP_A) return false;
+	if (ssa > eea && sa < ea) return false;
+	if (ssa < eea && sa > ea) return false;
 
-    std::unique_ptr<ARC> prim = std::make_unique<ARC>();
-    prim->center = this->center;
-    prim->radius = this->radius;
+    ret->center = this->center;
+    ret->radius = this->radius;
 
-    prim->clockWise = this->clockWise;
-    prim->startAngle = this->center.angleTo(p1);
-    prim->endAngle = this->center.angleTo(p2);
-    prim->terms[0].x = p1.x; prim->terms[0].y = p1.y;
-    prim->terms[1].x = p2.x; prim->terms[1].y = p2.y;
+    ret->clockWise = this->clockWise;
+    ret->startAngle = a1;
+    ret->endAngle = a2;
+    ret->terms[0].x = p1.x; ret->terms[0].y = p1.y;
+    ret->terms[1].x = p2.x; ret->terms[1].y = p2.y;
 
-    return prim;
+    double ux1, uy1, ux2, uy2;
+    GetUnit(this->center, p1, &ux1, &uy1);
+    GetUnit(this->center, p2, &ux2, &uy2);
+    ret->updateCache(ux1, uy1, ux2, uy2);
+
+    return true;
 }
 
 bool ARC::isInsideAngle(double a) const {
-    double sa = startAngle;
-    double ea = endAngle;
-
-    this->makeAbsoluteAngles(&sa, &ea);
+    double sa = m_cache.sweepStart;
+    double ea = m_cache.sweepEnd;
     double range = std::abs(sa - ea);
     double d1 = std::abs(a - sa);
     double d2 = std::abs(a - ea);
@@ -148,6 +297,38 @@ bool ARC::isInsideAngle(double a) const {
     return false;
 }
 
+// Cross products against the unit vectors of both ends settle directions
+// clearly inside or outside the arc. Anything within CLEAR_MARGIN of an end,
+// far wider than the EP_A tolerance and the rounding of the cached vectors,
+// goes to isInsideAngle(), so the answer is always the one it gives.
+bool ARC::isInsideDirection(double dx, double dy) const {
+    double ax = m_cache.cosStart;
+    double ay = m_cache.sinStart;
+    double bx = m_cache.cosEnd;
+    double by = m_cache.sinEnd;
+    double range = std::abs(m_cache.sweepEnd - m_cache.sweepStart);
+    double margin = sqrt(dx * dx + dy * dy) * CLEAR_MARGIN;
+
+    // walk from a to b counter-clockwise
+    if (m_cache.sweepEnd < m_cache.sweepStart) {
+        std::swap(ax, bx);
+        std::swap(ay, by);
+    }
+    double fromA = ax * dy - ay * dx;
+    double toB = dx * by - dy * bx;
+    if (range <= 180) {
+        // the wedge is where both half planes meet
+        if (fromA > margin && toB > margin) return true;
+        if (fromA < -margin || toB < -margin) return false;
+    }
+    else {
+        // the complement is the short way back from b to a
+        if (fromA > margin || toB > margin) return true;
+        if (fromA < -margin && toB < -margin) return false;
+    }
+    return this->isInsideAngle(TERMINAL(0, 0).angleTo(TERMINAL(dx, dy)));
+}
+
 double ARC::getDistance(TERMINAL t, PTERMINAL ret) const
 {
     VERTEX v = VERTEX(t.x - this->center.x, t.y - this->center.y, 0);
@@ -161,24 +342,7 @@ double ARC::getDistance(TERMINAL t, PTERMINAL ret) const
 
 bool ARC::isConvex() const
 {
-    double sa = startAngle;
-    double ea = endAngle;
-
-    this->makeAbsoluteAngles(&sa, &ea);
-
-    double angle = sa + (ea - sa) / 10.0f;
-    VERTEX v1 = VERTEX(center.x + radius * cos(angle * M_PI / 180.0f),
-        center.y + radius * sin(angle * M_PI / 180.0f), 0.0f);
-    VERTEX v2 = VERTEX(terms[0].x, terms[0].y, 0);
-    v1.x -= v2.x; v1.y -= v2.y;
-    v2.x = center.x - v2.x; v2.y = center.y - v2.y;
-    v1 = v2.crossProduct(v1);
-    if (v1.z > 0) {
-        return false;
-    }
-    else{
-        return true;
-    }
+    return m_cache.convex;
 }
 
 VERTEX ARC::getPositiveDirection() const
@@ -214,6 +378,7 @@ void ARC::swapTerminals()
     terms[0] = t;
     double a = startAngle; startAngle = endAngle; endAngle = a;
     this->clockWise = !this->clockWise;
+    this->updateCache(m_cache.cosEnd, m_cache.sinEnd, m_cache.cosStart, m_cache.sinStart);
 }
 
 
@@ -246,6 +411,24 @@ bool ARC::hasSamePivot(const TERMINAL &p, PTERMINAL ret)
     return false;
 }
 
+// Besides both terminals the box takes in every axis extreme the arc sweeps
+// over, grown by the radius and angle tolerances used by isContainedPoint().
+void ARC::getBoundingBox(PTERMINAL mn, PTERMINAL mx) const
+{
+    const double margin = EP * 10 + radius * EP_A * M_PI / 180.0f;
+    *mn = terms[0];
+    *mx = terms[0];
+    terms[1].ensureRectContains(mn, mx);
+    static const double AXES[4][2] = { { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 } };
+    for (int i = 0; i < 4; i++) {
+        if (!this->isInsideDirection(AXES[i][0], AXES[i][1])) continue;
+        TERMINAL t = TERMINAL(center.x + radius * AXES[i][0], center.y + radius * AXES[i][1]);
+        t.ensureRectContains(mn, mx);
+    }
+    mn->x -= margin; mn->y -= margin;
+    mx->x += margin; mx->y += margin;
+}
+
 void ARC::doOffsetOperation()
 {
     this->terms[0] = offsets[0];
@@ -255,23 +438,49 @@ void ARC::doOffsetOperation()
     double ea = center.angleTo(terms[1]);
     this->startAngle = sa;
     this->endAngle = ea;
+
+    double ux1, uy1, ux2, uy2;
+    GetUnit(this->center, terms[0], &ux1, &uy1);
+    GetUnit(this->center, terms[1], &ux2, &uy2);
+    this->updateCache(ux1, uy1, ux2, uy2);
 }
 
 bool ARC::isContainedPoint(TERMINAL p) const
 {
-    double alpha = center.angleTo(p);
     double r = this->center.distanceTo(p);
     if (std::abs(this->radius - r) > EP) return false;
-    if (this->isInsideAngle(alpha)) return true;
-
-    return false;
+    return this->isInsideDirection(p.x - center.x, p.y - center.y);
 }
 
 std::unique_ptr<PRIMITIVE> ARC::tryOffset(double offset) const
+{
+    std::unique_ptr<ARC> ret = std::make_unique<ARC>();
+    this->getOffset(offset, ret.get());
+    return ret;
+}
+
+PRIMITIVE *ARC::tryOffset(double offset, ARENA *arena) const
+{
+    ARC *ret = arena->create<ARC>();
+    this->getOffset(offset, ret);
+    return ret;
+}
+
+PRIMVALUE ARC::tryOffsetValue(double offset) const
+{
+    ARC ret;
+    this->getOffset(offset, &ret);
+    return PRIMVALUE(ret);
+}
+
+// Angles and orientation stay, so the offset arc shares the cache, its
+// convexity included, as the test scales with the square of the radius. The
+// ends still come from the angles, as the cached vectors may have come from
+// the end points and differ from them in the last bits.
+void ARC::getOffset(double offset, ARC *ret) const
 {
     if (!this->isConvex()) offset = -offset;
 
-    std::unique_ptr<ARC> ret = std::make_unique<ARC>();
     ret->center = this->center;
     ret->radius = this->radius + offset;
     ret->startAngle = this->startAngle;
@@ -281,8 +490,7 @@ std::unique_ptr<PRIMITIVE> ARC::tryOffset(double offset) const
         * M_PI / 180.0f), ret->center.y + ret->radius * sin(ret->startAngle * M_PI / 180.0f));
     ret->terms[1] = TERMINAL(ret->center.x + ret->radius * cos(ret->endAngle
         * M_PI / 180.0f), ret->center.y + ret->radius * sin(ret->endAngle * M_PI / 180.0f));
-
-    return ret;
+    ret->m_cache = m_cache;
 }
 
 VERTEX ARC::getTangent(TERMINAL p) const
@@ -317,27 +525,27 @@ void ARC::write2Stream(FILE *pFile) const
 	fwrite(&(this->clockWise), 1, sizeof(bool), pFile);
 }
 
-void ARC::readFromStream(FILE *pFile) const
+void ARC::readFromStream(FILE *pFile)
 {
-	fread((void *)&(this->terms[0].x), 1, sizeof(double), pFile);
-	fread((void *)&(this->terms[0].y), 1, sizeof(double), pFile);
-	fread((void *)&(this->terms[1].x), 1, sizeof(double), pFile);
-	fread((void *)&(this->terms[1].y), 1, sizeof(double), pFile);
-	fread((void *)&(this->center.x), 1, sizeof(double), pFile);
-	fread((void *)&(this->center.y), 1, sizeof(double), pFile);
-	fread((void *)&(this->radius), 1, sizeof(double), pFile);
-	fread((void *)&(this->startAngle), 1, sizeof(double), pFile);
-	fread((void *)&(this->endAngle), 1, sizeof(double), pFile);
-	fread((void *)&(this->clockWise), 1, sizeof(bool), pFile);
+	fread(&(this->terms[0].x), 1, sizeof(double), pFile);
+	fread(&(this->terms[0].y), 1, sizeof(double), pFile);
+	fread(&(this->terms[1].x), 1, sizeof(double), pFile);
+	fread(&(this->terms[1].y), 1, sizeof(double), pFile);
+	fread(&(this->center.x), 1, sizeof(double), pFile);
+	fread(&(this->center.y), 1, sizeof(double), pFile);
+	fread(&(this->radius), 1, sizeof(double), pFile);
+	fread(&(this->startAngle), 1, sizeof(double), pFile);
+	fread(&(this->endAngle), 1, sizeof(double), pFile);
+	fread(&(this->clockWise), 1, sizeof(bool), pFile);
+	this->updateCache();
 }
 
 double ARC::getPositiveDelta(TERMINAL t)
 {
     if (this->isContainedPoint(t) == false) return -1;
     double a = this->center.angleTo(t);
-    double sa = startAngle;
-    double ea = endAngle;
-    this->makeAbsoluteAngles(&sa, &ea);
+    double sa = m_cache.sweepStart;
+    double ea = m_cache.sweepEnd;
     double range = std::abs(sa - ea);
     double d1 = std::abs(a - sa);
     double d2 = std::abs(a - ea);
@@ -360,9 +568,8 @@ double ARC::getNegativeDelta(TERMINAL t)
 {
     if (this->isContainedPoint(t) == false) return -1;
     double a = this->center.angleTo(t);
-    double sa = startAngle;
-    double ea = endAngle;
-    this->makeAbsoluteAngles(&sa, &ea);
+    double sa = m_cache.sweepStart;
+    double ea = m_cache.sweepEnd;
     double range = std::abs(sa - ea);
     double d1 = std::abs(a - sa);
     double d2 = std::abs(a - ea);
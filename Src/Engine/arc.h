@@ -9,19 +9,50 @@ struct ARC : public PRIMITIVE
 
     ARC();
     ARC(TERMINAL c, TERMINAL t1, TERMINAL t2, bool cw);
+    // For ends known to lie at r > 0 from c.
+    ARC(TERMINAL c, double r, TERMINAL t1, TERMINAL t2, bool cw);
     ARC(TERMINAL c, double r, double sa, double ea, bool cw);
     ARC(TERMINAL c, double r, double sa, double ea, TERMINAL t1, TERMINAL t2, bool cw);
 
     virtual ~ARC();
 
+    // Values derived from the fields above, so the containment tests need
+    // no libm calls. updateCache() has to follow any direct change of those
+    // fields or of terms[0], which convexity is measured against. The end
+    // directions are measured against the end points, which may sit off the
+    // circle by up to EP, so they are not kept.
+    struct CACHE
+    {
+        double cosStart;
+        double sinStart;
+        double cosEnd;
+        double sinEnd;
+        double sweepStart;
+        double sweepEnd;
+        bool convex;
+    };
+
+    void updateCache();
+    const CACHE &getCache() const { return m_cache; }
+    void setCache(const CACHE &cache) { m_cache = cache; }
+
     void makeAbsoluteAngles(double *sa, double *ea) const;
 
     bool isInsideAngle(double a) const;
+    bool isInsideDirection(double dx, double dy) const;
 
     virtual std::unique_ptr<PRIMITIVE> clone() const override;
     virtual std::unique_ptr<PRIMITIVE> clone(const TERMINAL &p) const override;
     virtual std::unique_ptr<PRIMITIVE> clone(const TERMINAL &p1, const TERMINAL &p2) const override;
     virtual std::unique_ptr<PRIMITIVE> tryOffset(double offset) const override;
+    virtual PRIMITIVE *clone(ARENA *arena) const override;
+    virtual PRIMITIVE *clone(const TERMINAL &p, ARENA *arena) const override;
+    virtual PRIMITIVE *clone(const TERMINAL &p1, const TERMINAL &p2, ARENA *arena) const override;
+    virtual PRIMITIVE *tryOffset(double offset, ARENA *arena) const override;
+    virtual PRIMVALUE cloneValue() const override;
+    virtual PRIMVALUE cloneValue(const TERMINAL &p) const override;
+    virtual PRIMVALUE cloneValue(const TERMINAL &p1, const TERMINAL &p2) const override;
+    virtual PRIMVALUE tryOffsetValue(double offset) const override;
 
     virtual VERTEX getPositiveDirection() const override;
     virtual VERTEX getNegativeDirection() const override;
@@ -40,6 +71,16 @@ struct ARC : public PRIMITIVE
 
     virtual void swapTerminals() override;
     virtual void write2Stream(FILE *pFile) const override;
-	virtual void readFromStream(FILE *pFile) const override;
+	virtual void readFromStream(FILE *pFile) override;
+    virtual void getBoundingBox(PTERMINAL mn, PTERMINAL mx) const override;
     virtual void doOffsetOperation() override;
+
+private:
+    CACHE m_cache;
+
+    void updateCache(double cosStart, double sinStart, double cosEnd, double sinEnd);
+    void getCopy(ARC *ret) const;
+    bool getClone(const TERMINAL &p, ARC *ret) const;
+    bool getClone(const TERMINAL &p1, const TERMINAL &p2, ARC *ret) const;
+    void getOffset(double offset, ARC *ret) const;
 };
@@ -0,0 +1,48 @@
+#include "arena.h"
+
+#include <atomic>
+
+static std::atomic<unsigned long long> allocationCount(0);
+
+unsigned long long GetAllocationCount() {
+    return allocationCount.load();
+}
+
+void CountAllocation() {
+    allocationCount++;
+}
+
+static const std::size_t ALIGNMENT = 16;
+
+ARENA::ARENA(std::size_t blockSize) {
+    m_block = 0;
+    m_used = 0;
+    m_blockSize = blockSize;
+}
+
+ARENA::~ARENA() {
+    for (std::size_t i = 0; i < m_blocks.size(); i++) {
+        delete[] m_blocks[i];
+    }
+}
+
+void *ARENA::allocate(std::size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (size > m_blockSize) return NULL;
+    if (m_block < m_blocks.size() && m_used + size > m_blockSize) {
+        m_block++;
+        m_used = 0;
+    }
+    if (m_block == m_blocks.size()) {
+        m_blocks.push_back(new char[m_blockSize]);
+        CountAllocation();
+    }
+    void *p = m_blocks[m_block] + m_used;
+    m_used += size;
+    return p;
+}
+
+void ARENA::reset() {
+    m_block = 0;
+    m_used = 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator for short-lived primitives. Memory comes from a list of
+// blocks that reset() rewinds without freeing, so an operation that resets
+// between steps touches the heap only while the arena grows to its peak.
+// Destructors are never run: only objects without resources of their own,
+// such as LINE and ARC, may be created here, and none larger than a block.
+struct ARENA
+{
+    explicit ARENA(std::size_t blockSize = 16384);
+    ~ARENA();
+
+    void *allocate(std::size_t size);
+    void reset();
+
+    template <class T, class... ARGS>
+    T *create(ARGS&&... args)
+    {
+        return new (this->allocate(sizeof(T))) T(std::forward<ARGS>(args)...);
+    }
+
+private:
+    ARENA(const ARENA &);
+    ARENA &operator=(const ARENA &);
+
+    std::vector<char*> m_blocks;
+    std::size_t m_block;
+    std::size_t m_used;
+    std::size_t m_blockSize;
+};
+
+// Heap allocations of primitives and arena blocks since start-up. The
+// difference across a call is the number of allocations it made.
+unsigned long long GetAllocationCount();
+void CountAllocation();
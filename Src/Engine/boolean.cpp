@@ -0,0 +1,371 @@
+#include "boolean.h"
+#include "broadphase.h"
+#include "global.h"
+#include "primvalue.h"
+#include "sweep.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+
+// pr is a part of primitive primIndex of shape shpIndex, so its crossings
+// are a subset of the ones the table holds for that primitive. Per shape
+// the crossing nearest along pr wins, as getSelfIntersection() picks it, and
+// then the shape whose crossing is closest to the start of pr.
+bool BOOLEANENGINE::getIntersection(int shpIndex, int primIndex, PRIMITIVE *pr, TERMINAL *t, int *retIndex, int *retShapeIndex, SHAPE **shp) {
+    double mn = M_INFINITE;
+    bool ret = false;
+    const CROSSING *crossings = m_table.getCrossings(shpIndex, primIndex);
+    int count = m_table.getCount(shpIndex, primIndex);
+    int n = 0;
+
+    while (n < count) {
+        int i = crossings[n].shape;
+        bool flag = false;
+        double best = 0;
+        int idx = -1;
+        TERMINAL p;
+
+        for (; n < count && crossings[n].shape == i; n++) {
+            if (m_shapes[i].isIntersected == false) continue;
+            if (m_shapes[i].isCompleted == false) continue;
+            const TERMINAL &c = crossings[n].p;
+            if (pr->terms[0].isEqual(c) || pr->terms[1].isEqual(c)) continue;
+            if (pr->isContainedPoint(c) == false) continue;
+            double m = pr->getPositiveDelta(c);
+            if (flag == false || m < best) {
+                flag = true;
+                best = m;
+                idx = crossings[n].prim;
+                p = c;
+            }
+        }
+        if (flag) {
+            double m = p.distanceTo(pr->terms[0]);
+            if (m < mn) {
+                *shp = &(m_shapes[i]);
+                mn = m;
+                *retIndex = idx;
+                *retShapeIndex = i;
+                *t = p;
+                ret = true;
+            }
+        }
+    }
+    return ret;
+}
+
+bool BOOLEANENGINE::doShapeBooleanOPT(SHAPE *shp, int shpIndex, ARENA *arena, std::vector<SHAPE> *subShapes) {
+    bool retFlag = false;
+
+    for (std::size_t i = 0; i < shp->prims.size(); i++) {
+        TERMINAL t;
+        SHAPE *intersected = NULL;
+        int primIndex;
+        int otherShapeIndex;
+
+        arena->reset();
+        PRIMVALUE pr = shp->prims[i]->cloneValue();
+
+        if (!pr.hasValue()) continue;
+        while(getIntersection(shpIndex, i, pr.get(), &t, &primIndex, &otherShapeIndex, &intersected)) {
+            SHAPE tshp;
+            TERMINAL st = pr->terms[0];
+            TERMINAL et = t;
+            PRIMITIVE *prim = shp->prims[i]->clone(st, et, arena);
+
+            retFlag = true;
+            if (!Charge(m_budget, 0)) return retFlag;
+
+            if (prim == NULL) break;
+            if (m_shapes[otherShapeIndex].isInsidePoint(prim, primIndex))
+            {
+                pr = shp->prims[i]->cloneValue(et);
+                if (!pr.hasValue()) break;
+                continue;
+            }
+
+            tshp.prims.push_back(prim->clone());
+            while (true)
+            {
+                if (!Charge(m_budget, 1)) return retFlag;
+                int m = primIndex;
+                PRIMITIVE *pr1 = intersected->prims[primIndex]->clone(t, arena);
+                if (pr1 == NULL) break;
+                if (getIntersection(otherShapeIndex, m, pr1, &t, &primIndex, &otherShapeIndex, &intersected)) {
+					std::unique_ptr<PRIMITIVE> pr2 = pr1->clone(pr1->terms[0], t);
+					if (pr2 == NULL) break;
+                    tshp.prims.push_back(std::move(pr2));
+                }
+                else{
+                    tshp.prims.push_back(pr1->clone());
+                    primIndex = m;
+                    primIndex++;
+                    if ((std::size_t)primIndex >= intersected->prims.size()) primIndex = 0;
+                    t = pr1->terms[1];
+                }
+                if (t.isEqual(st)) break;
+            }
+            tshp.update();
+			if (tshp.isCompleted)
+				subShapes->push_back(std::move(tshp));
+			else {
+				tshp.clear();
+				tshp.prims.clear();
+			}
+            pr = shp->prims[i]->cloneValue(et);
+            if (!pr.hasValue()) break;
+        }
+    }
+    if (subShapes->size() > 1) {
+        removeDuplicated(subShapes);
+    }
+    if (retFlag == false) {
+        // only a shape whose box overlaps this one can contain it, and
+        // findClusters() put every such shape in the same cluster
+        const std::vector<int> &neighbours = m_neighbours[shpIndex];
+        int n = 0;
+        for (std::size_t k = 0; k < neighbours.size(); k++) {
+            int i = neighbours[k];
+            if (m_cluster[i] != m_cluster[shpIndex]) continue;
+            SHAPE *cloneShape = m_shapes[i].clone();
+            if (cloneShape->isPositive == false) {
+                cloneShape->turnPrimitiveOut();
+            }
+            if (cloneShape->isInsideShape(shp)) {
+                n += m_shapes[i].isPositive ? +1 : -1;
+            }
+            cloneShape->clear();
+            delete cloneShape;
+        }
+        if (shp->isPositive) n++;
+        if(n > 1) shp->isValid = false;
+    }
+    return retFlag;
+}
+
+BOOLEANENGINE::BOOLEANENGINE() {
+    m_budget = NULL;
+}
+
+void BOOLEANENGINE::setBudget(BUDGET *budget) {
+    m_budget = budget;
+}
+
+bool BOOLEANENGINE::isIntersected(SHAPE *shp1, SHAPE *shp2) {
+    if (shp1->isBoxOverlapped(shp2) == false) return false;
+    for (std::size_t i = 0; i < shp1->prims.size(); i++) {
+        TERMINAL t;
+        int index;
+        if (shp2->getSelfIntersection(-1, shp1->prims[i].get(), &t, &index)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BOOLEANENGINE::execute(const SHAPE *shapes, std::size_t count, std::vector<SHAPE> *results) {
+    m_shapes.assign(shapes, shapes + count);
+    this->execute();
+    results->insert(results->end(),
+                    std::make_move_iterator(m_shapes.begin()),
+                    std::make_move_iterator(m_shapes.end()));
+    m_shapes.clear();
+}
+
+void BOOLEANENGINE::execute(std::vector<SHAPE> *shapes) {
+    m_shapes.swap(*shapes);
+    this->execute();
+    m_shapes.swap(*shapes);
+    m_shapes.clear();
+}
+
+// A shape whose box overlaps none of the changed ones can neither cross
+// them nor contain them, so following the overlaps from the changed shapes
+// reaches every shape a full pass would treat differently.
+void BOOLEANENGINE::executeChanged(std::vector<SHAPE> *shapes, std::vector<int> *changed) {
+    std::vector<std::vector<int>> neighbours;
+    std::vector<char> marked(shapes->size(), 0);
+    std::vector<int> stack;
+    std::vector<SHAPE> rest;
+
+    FindShapeNeighbours(shapes, &neighbours);
+    for (std::size_t k = 0; k < changed->size(); k++) {
+        int i = changed->at(k);
+        if (i < 0 || (std::size_t)i >= shapes->size() || marked[i]) continue;
+        marked[i] = 1;
+        stack.push_back(i);
+    }
+    while (stack.size() > 0) {
+        int i = stack.back();
+        stack.pop_back();
+        for (std::size_t k = 0; k < neighbours[i].size(); k++) {
+            int j = neighbours[i][k];
+            if (marked[j]) continue;
+            marked[j] = 1;
+            stack.push_back(j);
+        }
+    }
+
+    changed->clear();
+    m_shapes.clear();
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        if (marked[i]) {
+            changed->push_back((int)i);
+            m_shapes.push_back(std::move(shapes->at(i)));
+        }
+        else {
+            rest.push_back(std::move(shapes->at(i)));
+        }
+    }
+    this->execute();
+    rest.insert(rest.end(),
+                std::make_move_iterator(m_shapes.begin()),
+                std::make_move_iterator(m_shapes.end()));
+    m_shapes.clear();
+    shapes->swap(rest);
+}
+
+static int FindRoot(std::vector<int> *parent, int i) {
+    while (parent->at(i) != i) {
+        parent->at(i) = parent->at(parent->at(i));
+        i = parent->at(i);
+    }
+    return i;
+}
+
+static void JoinRoots(std::vector<int> *parent, int i, int j) {
+    i = FindRoot(parent, i);
+    j = FindRoot(parent, j);
+    if (i < j) parent->at(j) = i;
+    else if (j < i) parent->at(i) = j;
+}
+
+// Whether every start point of inner lies in the box of outer, which
+// isInsideShape() needs before it can say inner is inside outer.
+static bool IsInsideBox(SHAPE *inner, SHAPE *outer) {
+    TERMINAL mn, mx;
+    if (!outer->getBoundingBox(&mn, &mx)) return false;
+    for (std::size_t i = 0; i < inner->prims.size(); i++) {
+        const TERMINAL &t = inner->prims[i]->terms[0];
+        if (t.x < mn.x - EP || t.x > mx.x + EP || t.y < mn.y - EP || t.y > mx.y + EP) return false;
+    }
+    return true;
+}
+
+// Joins two shapes when one crosses the other or may contain it, and lists
+// each connected group ascending, largest group first. Nothing one cluster
+// does can change what another sees, so they can run on separate threads.
+void BOOLEANENGINE::findClusters() {
+    int count = (int)m_shapes.size();
+    std::vector<int> parent(count);
+
+    for (int i = 0; i < count; i++) {
+        parent[i] = i;
+    }
+    for (int i = 0; i < count; i++) {
+        for (int p = 0; p < (int)m_shapes[i].prims.size(); p++) {
+            const CROSSING *crossings = m_table.getCrossings(i, p);
+            for (int n = m_table.getCount(i, p) - 1; n >= 0; n--) {
+                JoinRoots(&parent, i, crossings[n].shape);
+            }
+        }
+        for (std::size_t k = 0; k < m_neighbours[i].size(); k++) {
+            int j = m_neighbours[i][k];
+            if (j < i || FindRoot(&parent, i) == FindRoot(&parent, j)) continue;
+            if (IsInsideBox(&m_shapes[i], &m_shapes[j]) || IsInsideBox(&m_shapes[j], &m_shapes[i])) {
+                JoinRoots(&parent, i, j);
+            }
+        }
+    }
+
+    m_cluster.assign(count, -1);
+    m_clusters.clear();
+    for (int i = 0; i < count; i++) {
+        int root = FindRoot(&parent, i);
+        if (m_cluster[root] == -1) {
+            m_cluster[root] = (int)m_clusters.size();
+            m_clusters.push_back(std::vector<int>());
+        }
+        m_cluster[i] = m_cluster[root];
+        m_clusters[m_cluster[i]].push_back(i);
+    }
+    std::vector<int> order(m_clusters.size());
+    for (std::size_t c = 0; c < order.size(); c++) {
+        order[c] = (int)c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return m_clusters[a].size() > m_clusters[b].size();
+    });
+    std::vector<std::vector<int>> clusters(order.size());
+    for (std::size_t c = 0; c < order.size(); c++) {
+        clusters[c].swap(m_clusters[order[c]]);
+        for (std::size_t k = 0; k < clusters[c].size(); k++) {
+            m_cluster[clusters[c][k]] = (int)c;
+        }
+    }
+    m_clusters.swap(clusters);
+}
+
+void BOOLEANENGINE::executeShape(int shpIndex, ARENA *arena, std::vector<SHAPE> *results) {
+    SHAPE &shp = m_shapes[shpIndex];
+    if (shp.isCompleted == false) {
+        results->push_back(shp);
+        return;
+    }
+    std::vector<SHAPE> subShapes;
+
+    bool ret = doShapeBooleanOPT(&shp, shpIndex, arena, &subShapes);
+
+    if (subShapes.size() > 0 || ret == true) {
+        shp.isValid = false;
+        shp.isIntersected = true;
+        for (std::size_t j = 0; j < subShapes.size(); j++) {
+            results->push_back(std::move(subShapes[j]));
+        }
+    }
+    else if(shp.isValid) {
+        results->push_back(shp);
+        shp.isIntersected = false;
+    }
+}
+
+// Each cluster runs its shapes in ascending order, as the single loop over
+// all shapes did, and the results are gathered back in that order.
+void BOOLEANENGINE::execute() {
+    if (m_shapes.size() < 2) return;
+    std::vector<SHAPE> newShapes;
+    std::vector<std::vector<SHAPE>> results(m_shapes.size());
+
+    for (std::size_t i = 0; i < m_shapes.size(); i++) {
+        m_shapes[i].isIntersected = true;
+    }
+    FindShapeNeighbours(&m_shapes, &m_neighbours);
+    m_table.build(&m_shapes);
+    this->findClusters();
+
+    while (m_arenas.size() < (std::size_t)GetThreadCount()) {
+        m_arenas.push_back(std::unique_ptr<ARENA>(new ARENA()));
+    }
+    ParallelFor((int)m_clusters.size(), [&](int c, int worker) {
+        const std::vector<int> &cluster = m_clusters[c];
+        for (std::size_t k = 0; k < cluster.size(); k++) {
+            if (IsSpent(m_budget)) break;
+            this->executeShape(cluster[k], m_arenas[worker].get(), &results[cluster[k]]);
+        }
+    });
+
+    for (std::size_t i = 0; i < results.size(); i++) {
+        for (std::size_t j = 0; j < results[i].size(); j++) {
+            newShapes.push_back(std::move(results[i][j]));
+        }
+    }
+    m_table.clear();
+    m_neighbours.clear();
+    m_cluster.clear();
+    m_clusters.clear();
+    m_shapes.clear();
+    removeDuplicated(&newShapes);
+    m_shapes.swap(newShapes);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "shape.h"
+#include "sweep.h"
+
+#include <memory>
+#include <vector>
+
+// Merges overlapping shapes and drops shapes swallowed by others. The engine
+// keeps its own working copy, so it can be reused across calls and never
+// touches anything but the shapes it is given. Shapes that cannot cross or
+// contain each other fall into separate clusters, which are resolved on
+// worker threads; the result is the same for any number of threads.
+struct BOOLEANENGINE
+{
+    BOOLEANENGINE();
+
+    void execute(const SHAPE *shapes, std::size_t count, std::vector<SHAPE> *results);
+    void execute(std::vector<SHAPE> *shapes);
+
+    // Merges only the shapes listed in changed and those linked to them by
+    // overlapping boxes, taking the others as merged already. Those shapes
+    // leave shapes, the rest keep their order, and the results are added at
+    // the end; changed is set to the ascending indices that were taken out.
+    void executeChanged(std::vector<SHAPE> *shapes, std::vector<int> *changed);
+
+    bool isIntersected(SHAPE *shp1, SHAPE *shp2);
+
+    // Charges the walks of later calls to budget, NULL for none. Once it is
+    // spent the remaining shapes are left as they are and the result is
+    // only good for throwing away; budget->getStatus() tells why.
+    void setBudget(BUDGET *budget);
+
+private:
+    void execute();
+    void findClusters();
+    void executeShape(int shpIndex, ARENA *arena, std::vector<SHAPE> *results);
+    bool getIntersection(int shpIndex, int primIndex, PRIMITIVE *pr, TERMINAL *t, int *retIndex, int *retShapeIndex, SHAPE **shp);
+    bool doShapeBooleanOPT(SHAPE *shp, int shpIndex, ARENA *arena, std::vector<SHAPE> *subShapes);
+
+    std::vector<SHAPE> m_shapes;
+    CROSSINGTABLE m_table;
+    std::vector<std::vector<int>> m_neighbours;
+    std::vector<int> m_cluster;
+    std::vector<std::vector<int>> m_clusters;
+    std::vector<std::unique_ptr<ARENA>> m_arenas;
+    BUDGET *m_budget;
+};
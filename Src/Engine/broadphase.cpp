@@ -0,0 +1,65 @@
+#include "broadphase.h"
+
+#include <algorithm>
+
+struct SHAPEBOX
+{
+    TERMINAL mn;
+    TERMINAL mx;
+    int shape;
+};
+
+static bool lessLeft(const SHAPEBOX &a, const SHAPEBOX &b) {
+    if (a.mn.x != b.mn.x) return a.mn.x < b.mn.x;
+    return a.shape < b.shape;
+}
+
+void FindOverlappingShapes(std::vector<SHAPE> *shapes, std::vector<std::pair<int, int>> *pairs) {
+    FindOverlappingShapes(shapes, 0, pairs);
+}
+
+void FindOverlappingShapes(std::vector<SHAPE> *shapes, double margin, std::vector<std::pair<int, int>> *pairs) {
+    std::vector<SHAPEBOX> boxes;
+    std::vector<int> active;
+
+    pairs->clear();
+    boxes.reserve(shapes->size());
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        SHAPEBOX b;
+        if (!shapes->at(i).getBoundingBox(&b.mn, &b.mx)) continue;
+        b.mn.x -= margin; b.mn.y -= margin;
+        b.mx.x += margin; b.mx.y += margin;
+        b.shape = (int)i;
+        boxes.push_back(b);
+    }
+    std::sort(boxes.begin(), boxes.end(), lessLeft);
+
+    for (std::size_t i = 0; i < boxes.size(); i++) {
+        const SHAPEBOX &b = boxes[i];
+        std::size_t k = 0;
+        for (std::size_t j = 0; j < active.size(); j++) {
+            const SHAPEBOX &a = boxes[active[j]];
+            if (a.mx.x < b.mn.x) continue;
+            active[k++] = active[j];
+            if (a.mn.y > b.mx.y || b.mn.y > a.mx.y) continue;
+            pairs->push_back(std::make_pair(std::min(a.shape, b.shape), std::max(a.shape, b.shape)));
+        }
+        active.resize(k);
+        active.push_back((int)i);
+    }
+    std::sort(pairs->begin(), pairs->end());
+}
+
+void FindShapeNeighbours(std::vector<SHAPE> *shapes, std::vector<std::vector<int>> *neighbours) {
+    std::vector<std::pair<int, int>> pairs;
+
+    FindOverlappingShapes(shapes, &pairs);
+    neighbours->assign(shapes->size(), std::vector<int>());
+    for (std::size_t i = 0; i < pairs.size(); i++) {
+        neighbours->at(pairs[i].first).push_back(pairs[i].second);
+        neighbours->at(pairs[i].second).push_back(pairs[i].first);
+    }
+    for (std::size_t i = 0; i < neighbours->size(); i++) {
+        std::sort(neighbours->at(i).begin(), neighbours->at(i).end());
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "shape.h"
+
+#include <utility>
+#include <vector>
+
+// Broad phase over whole shapes: sorts the shape bounding boxes by their
+// left edge and sweeps them, reporting every pair (i < j) whose boxes
+// overlap. Shapes without primitives never overlap anything.
+void FindOverlappingShapes(std::vector<SHAPE> *shapes, std::vector<std::pair<int, int>> *pairs);
+
+// The same with every box grown by margin on each side, so the pairs are
+// those whose boxes come closer than twice the margin.
+void FindOverlappingShapes(std::vector<SHAPE> *shapes, double margin, std::vector<std::pair<int, int>> *pairs);
+
+// The same pairs as lists, neighbours->at(i) holding the ascending indices
+// of the shapes whose boxes overlap the box of shape i.
+void FindShapeNeighbours(std::vector<SHAPE> *shapes, std::vector<std::vector<int>> *neighbours);
@@ -0,0 +1,57 @@
+#include "budget.h"
+
+// The clock is read once per this many iterations.
+static const std::int64_t CLOCK_INTERVAL = 256;
+
+BUDGET::BUDGET() : m_iterations(0), m_primitives(0), m_status(BUDGET_OK) {
+    maxIterations = 0;
+    maxPrimitives = 0;
+    seconds = 0;
+    cancel = NULL;
+    this->start();
+}
+
+void BUDGET::start() {
+    m_iterations = 0;
+    m_primitives = 0;
+    m_status = BUDGET_OK;
+    m_deadline = std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+// The first reason to stop is the one reported.
+void BUDGET::stop(int status) {
+    int ok = BUDGET_OK;
+    m_status.compare_exchange_strong(ok, status);
+}
+
+bool BUDGET::charge(std::size_t primitives) {
+    if (m_status != BUDGET_OK) return false;
+    if (cancel != NULL && *cancel) {
+        stop(BUDGET_CANCELLED);
+        return false;
+    }
+    std::int64_t n = ++m_iterations;
+    std::int64_t p = m_primitives += (std::int64_t)primitives;
+    if ((maxIterations > 0 && n > maxIterations) || (maxPrimitives > 0 && p > maxPrimitives)) {
+        stop(BUDGET_EXCEEDED);
+        return false;
+    }
+    if (n % CLOCK_INTERVAL == 0) return !this->isSpent();
+    return true;
+}
+
+bool BUDGET::isSpent() {
+    if (m_status != BUDGET_OK) return true;
+    if (cancel != NULL && *cancel) {
+        stop(BUDGET_CANCELLED);
+    }
+    else if (seconds > 0 && std::chrono::steady_clock::now() > m_deadline) {
+        stop(BUDGET_EXCEEDED);
+    }
+    return m_status != BUDGET_OK;
+}
+
+int BUDGET::getStatus() const {
+    return m_status;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+enum _BUDGET_STATUS_
+{
+    BUDGET_OK = 0,
+    BUDGET_CANCELLED = 1,
+    BUDGET_EXCEEDED = 2
+};
+
+// Limits on one engine call, and the token that cancels it. The walks that
+// could spin on degenerate input charge every step and every primitive they
+// emit here and give up once it is spent. A limit of 0 means none. The
+// worker threads of a call share it, so the counters are atomic.
+struct BUDGET
+{
+    BUDGET();
+
+    std::int64_t maxIterations;
+    std::int64_t maxPrimitives;
+    double seconds;
+    const std::atomic<bool> *cancel;
+
+    // Clears the counters and starts the clock.
+    void start();
+
+    // Charges one iteration that emitted primitives primitives; false once
+    // the budget is spent or the call was cancelled.
+    bool charge(std::size_t primitives);
+
+    // Checks the clock and the token without charging anything.
+    bool isSpent();
+    int getStatus() const;
+
+private:
+    BUDGET(const BUDGET &);
+    BUDGET &operator=(const BUDGET &);
+
+    void stop(int status);
+
+    std::atomic<std::int64_t> m_iterations;
+    std::atomic<std::int64_t> m_primitives;
+    std::atomic<int> m_status;
+    std::chrono::steady_clock::time_point m_deadline;
+};
+
+// The engine takes a NULL budget as an unlimited one.
+inline bool Charge(BUDGET *budget, std::size_t primitives)
+{
+    return budget == NULL || budget->charge(primitives);
+}
+
+inline bool IsSpent(BUDGET *budget)
+{
+    return budget != NULL && budget->isSpent();
+}
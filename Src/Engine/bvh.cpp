@@ -0,0 +1,88 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+static const int LEAF_SIZE = 4;
+
+BVH::BVH() {
+    m_count = 0;
+    m_built = false;
+}
+
+void BVH::clear() {
+    m_nodes.clear();
+    m_indices.clear();
+    m_mins.clear();
+    m_maxs.clear();
+    m_count = 0;
+    m_built = false;
+}
+
+bool BVH::isBuilt(std::size_t count) const {
+    return m_built && m_count == count;
+}
+
+bool BVH::getBounds(TERMINAL *mn, TERMINAL *mx) const {
+    if (m_nodes.empty()) return false;
+    *mn = m_nodes[0].mn;
+    *mx = m_nodes[0].mx;
+    return true;
+}
+
+void BVH::build(const PRIMITIVEARRAY &prims) {
+    int count = prims.getCount();
+
+    this->clear();
+    m_count = count;
+    m_built = true;
+    if (count == 0) return;
+
+    m_mins.resize(count);
+    m_maxs.resize(count);
+    m_indices.resize(count);
+    for (int i = 0; i < count; i++) {
+        prims.getBoundingBox(i, &m_mins[i], &m_maxs[i]);
+        m_indices[i] = i;
+    }
+    m_nodes.reserve(2 * count / LEAF_SIZE + 1);
+    buildNode(0, count);
+}
+
+int BVH::buildNode(int first, int count) {
+    int index = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(NODE());
+
+    TERMINAL mn = m_mins[m_indices[first]];
+    TERMINAL mx = m_maxs[m_indices[first]];
+    for (int i = first + 1; i < first + count; i++) {
+        m_mins[m_indices[i]].ensureRectContains(&mn, &mx);
+        m_maxs[m_indices[i]].ensureRectContains(&mn, &mx);
+    }
+    m_nodes[index].mn = mn;
+    m_nodes[index].mx = mx;
+
+    if (count <= LEAF_SIZE) {
+        m_nodes[index].first = first;
+        m_nodes[index].count = count;
+        m_nodes[index].right = -1;
+        return index;
+    }
+
+    // split at the median center along the longer side of the box
+    const bool alongX = (mx.x - mn.x) >= (mx.y - mn.y);
+    const std::vector<TERMINAL> &mins = m_mins;
+    const std::vector<TERMINAL> &maxs = m_maxs;
+    int half = count / 2;
+    std::nth_element(m_indices.begin() + first, m_indices.begin() + first + half,
+        m_indices.begin() + first + count, [&](int a, int b) {
+        return alongX ? mins[a].x + maxs[a].x < mins[b].x + maxs[b].x
+                      : mins[a].y + maxs[a].y < mins[b].y + maxs[b].y;
+    });
+
+    buildNode(first, half);
+    int right = buildNode(first + half, count - half);
+    m_nodes[index].first = first;
+    m_nodes[index].count = 0;
+    m_nodes[index].right = right;
+    return index;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "primarray.h"
+#include "terminal.h"
+
+#include <vector>
+
+// Axis-aligned bounding box tree over the primitives of one shape. Leaves
+// refer to primitives by their index in the shape, so the tree has to be
+// rebuilt whenever primitives are added, removed, reordered or moved.
+struct BVH
+{
+    BVH();
+
+    void build(const PRIMITIVEARRAY &prims);
+    void clear();
+
+    bool isBuilt(std::size_t count) const;
+    bool getBounds(TERMINAL *mn, TERMINAL *mx) const;
+
+    // Calls f(index) for every primitive whose box overlaps [mn, mx].
+    template <class F>
+    void visit(const TERMINAL &mn, const TERMINAL &mx, F f) const;
+
+private:
+    struct NODE
+    {
+        TERMINAL mn;
+        TERMINAL mx;
+        int first;
+        int count;
+        int right;
+    };
+
+    int buildNode(int first, int count);
+    static bool isOverlapped(const TERMINAL &mn1, const TERMINAL &mx1,
+        const TERMINAL &mn2, const TERMINAL &mx2);
+
+    std::vector<NODE> m_nodes;
+    std::vector<int> m_indices;
+    std::vector<TERMINAL> m_mins;
+    std::vector<TERMINAL> m_maxs;
+    std::size_t m_count;
+    bool m_built;
+};
+
+inline bool BVH::isOverlapped(const TERMINAL &mn1, const TERMINAL &mx1,
+    const TERMINAL &mn2, const TERMINAL &mx2)
+{
+    return mn1.x <= mx2.x && mn2.x <= mx1.x && mn1.y <= mx2.y && mn2.y <= mx1.y;
+}
+
+// Nodes are stored depth first: the left child of a node directly follows
+// it and `right` holds the index of the right child. Leaves have count > 0.
+template <class F>
+void BVH::visit(const TERMINAL &mn, const TERMINAL &mx, F f) const
+{
+    if (m_nodes.empty()) return;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const NODE &node = m_nodes[stack[--top]];
+        if (!isOverlapped(node.mn, node.mx, mn, mx)) continue;
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                int k = m_indices[i];
+                if (isOverlapped(m_mins[k], m_maxs[k], mn, mx)) f(k);
+            }
+        }
+        else {
+            stack[top++] = node.right;
+            stack[top++] = static_cast<int>(&node - &m_nodes[0]) + 1;
+        }
+    }
+}
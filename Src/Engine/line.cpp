@@ -1,7 +1,6 @@
 #include "line.h"
 #include "global.h"
-
-#include <QTextStream>
+#include "primvalue.h"
 
 LINE::LINE() : PRIMITIVE() {
     nKind = GBAPY_LINE;
@@ -35,21 +34,74 @@ std::unique_ptr<PRIMITIVE> LINE::clone() const
 }
 
 std::unique_ptr<PRIMITIVE> LINE::clone(const TERMINAL &p) const
+{
+    LINE ret;
+    if (!this->getClone(p, &ret)) return NULL;
+    return std::make_unique<LINE>(ret);
+}
+
+std::unique_ptr<PRIMITIVE> LINE::clone(const TERMINAL &p1, const TERMINAL &p2) const
+{
+    LINE ret;
+    if (!this->getClone(p1, p2, &ret)) return NULL;
+    return std::make_unique<LINE>(ret);
+}
+
+PRIMITIVE *LINE::clone(ARENA *arena) const
+{
+    return arena->create<LINE>(this->terms[0], this->terms[1]);
+}
+
+PRIMITIVE *LINE::clone(const TERMINAL &p, ARENA *arena) const
+{
+    LINE ret;
+    if (!this->getClone(p, &ret)) return NULL;
+    return arena->create<LINE>(ret);
+}
+
+PRIMITIVE *LINE::clone(const TERMINAL &p1, const TERMINAL &p2, ARENA *arena) const
+{
+    LINE ret;
+    if (!this->getClone(p1, p2, &ret)) return NULL;
+    return arena->create<LINE>(ret);
+}
+
+PRIMVALUE LINE::cloneValue() const
+{
+    return PRIMVALUE(LINE(this->terms[0], this->terms[1]));
+}
+
+PRIMVALUE LINE::cloneValue(const TERMINAL &p) const
+{
+    LINE ret;
+    if (!this->getClone(p, &ret)) return PRIMVALUE();
+    return PRIMVALUE(ret);
+}
+
+PRIMVALUE LINE::cloneValue(const TERMINAL &p1, const TERMINAL &p2) const
+{
+    LINE ret;
+    if (!this->getClone(p1, p2, &ret)) return PRIMVALUE();
+    return PRIMVALUE(ret);
+}
+
+bool LINE::getClone(const TERMINAL &p, LINE *ret) const
 {
 	TERMINAL sp = p;
-	if (p.isEqual(this->terms[1])) return NULL;
-	if (this->isContainedPoint(p) == false) return NULL;
+	if (p.isEqual(this->terms[1])) return false;
+	if (this->isContainedPoint(p) == false) return false;
 	if (p.isEqual(this->terms[0])) sp = this->terms[0];
-    return std::make_unique<LINE>(TERMINAL(sp.x, sp.y), this->terms[1]);
+    *ret = LINE(TERMINAL(sp.x, sp.y), this->terms[1]);
+    return true;
 }
 
-std::unique_ptr<PRIMITIVE> LINE::clone(const TERMINAL &p1, const TERMINAL &p2) const
+bool LINE::getClone(const TERMINAL &p1, const TERMINAL &p2, LINE *ret) const
 {
 	TERMINAL sp = p1;
 	TERMINAL ep = p2;
-    if (p1.isEqual(p2)) return NULL;
-	if (this->isContainedPoint(p1) == false) return NULL;
-	if (this->isContainedPoint(p2) == false) return NULL;
+    if (p1.isEqual(p2)) return false;
+	if (this->isContainedPoint(p1) == false) return false;
+	if (this->isContainedPoint(p2) == false) return false;
 	if (sp.isEqual(this->terms[0])) sp = this->terms[0];
 	if (sp.isEqual(this->terms[1])) sp = this->terms[1];
 	if (ep.isEqual(this->terms[0])) ep = this->terms[0];
@@ -60,8 +112,9 @@ std::unique_ptr<PRIMITIVE> LINE::clone(const TERMINAL &p1, const TERMINAL &p2) c
 	v1.normalize();
 	v2.normalize();
 	v1.x -= v2.x; v1.y -= v2.y;
-	if (v1.magnitude() > 0.5f) return NULL;
-    return std::make_unique<LINE>(sp, ep);
+	if (v1.magnitude() > 0.5f) return false;
+    *ret = LINE(sp, ep);
+    return true;
 }
 
 VERTEX LINE::getPositiveDirection() const
@@ -155,6 +208,18 @@ bool LINE::isConvex() const
     return true;
 }
 
+// The box is grown by a margin so that every point isConflict() can accept
+// as lying on the line is inside it.
+void LINE::getBoundingBox(PTERMINAL mn, PTERMINAL mx) const
+{
+    const double margin = EP * 10;
+    *mn = terms[0];
+    *mx = terms[0];
+    terms[1].ensureRectContains(mn, mx);
+    mn->x -= margin; mn->y -= margin;
+    mx->x += margin; mx->y += margin;
+}
+
 void LINE::doOffsetOperation()
 {
     terms[0] = offsets[0]; terms[1] = offsets[1];
@@ -174,16 +239,35 @@ bool LINE::isContainedPoint(TERMINAL p) const
 }
 
 std::unique_ptr<PRIMITIVE> LINE::tryOffset(double offset) const
+{
+    std::unique_ptr<LINE> ret = std::make_unique<LINE>();
+    this->getOffset(offset, ret.get());
+    return ret;
+}
+
+PRIMITIVE *LINE::tryOffset(double offset, ARENA *arena) const
+{
+    LINE *ret = arena->create<LINE>();
+    this->getOffset(offset, ret);
+    return ret;
+}
+
+PRIMVALUE LINE::tryOffsetValue(double offset) const
+{
+    LINE ret;
+    this->getOffset(offset, &ret);
+    return PRIMVALUE(ret);
+}
+
+void LINE::getOffset(double offset, LINE *ret) const
 {
     VERTEX up = VERTEX(0, 0, 1);
-    std::unique_ptr<LINE> ret = std::make_unique<LINE>(terms[0], terms[1]);
+    *ret = LINE(terms[0], terms[1]);
     VERTEX v = VERTEX(terms[1].x - terms[0].x, terms[1].y - terms[0].y, 0);
     v = v.crossProduct(up);
     v.normalize();
     ret->terms[0].x += (v.x * offset); ret->terms[0].y += (v.y * offset);
     ret->terms[1].x += (v.x * offset); ret->terms[1].y += (v.y * offset);
-
-    return ret;
 }
 
 VERTEX LINE::getTangent(TERMINAL p) const
@@ -200,12 +284,12 @@ void LINE::write2Stream(FILE *pFile) const
 	fwrite(&(this->terms[1].y), 1, sizeof(double), pFile);
 }
 
-void LINE::readFromStream(FILE *pFile) const
+void LINE::readFromStream(FILE *pFile)
 {
-	fread((void *)&(this->terms[0].x), 1, sizeof(double), pFile);
-	fread((void *)&(this->terms[0].y), 1, sizeof(double), pFile);
-	fread((void *)&(this->terms[1].x), 1, sizeof(double), pFile);
-	fread((void *)&(this->terms[1].y), 1, sizeof(double), pFile);
+	fread(&(this->terms[0].x), 1, sizeof(double), pFile);
+	fread(&(this->terms[0].y), 1, sizeof(double), pFile);
+	fread(&(this->terms[1].x), 1, sizeof(double), pFile);
+	fread(&(this->terms[1].y), 1, sizeof(double), pFile);
 }
 
 double LINE::getPositiveDelta(TERMINAL t)
@@ -12,6 +12,14 @@ struct LINE : public PRIMITIVE
     virtual std::unique_ptr<PRIMITIVE> clone(const TERMINAL &p) const override;
     virtual std::unique_ptr<PRIMITIVE> clone(const TERMINAL &p1, const TERMINAL &p2) const override;
     virtual std::unique_ptr<PRIMITIVE> tryOffset(double offset) const override;
+    virtual PRIMITIVE *clone(ARENA *arena) const override;
+    virtual PRIMITIVE *clone(const TERMINAL &p, ARENA *arena) const override;
+    virtual PRIMITIVE *clone(const TERMINAL &p1, const TERMINAL &p2, ARENA *arena) const override;
+    virtual PRIMITIVE *tryOffset(double offset, ARENA *arena) const override;
+    virtual PRIMVALUE cloneValue() const override;
+    virtual PRIMVALUE cloneValue(const TERMINAL &p) const override;
+    virtual PRIMVALUE cloneValue(const TERMINAL &p1, const TERMINAL &p2) const override;
+    virtual PRIMVALUE tryOffsetValue(double offset) const override;
 
     virtual VERTEX getPositiveDirection() const override;
     virtual VERTEX getNegativeDirection() const override;
@@ -28,8 +36,14 @@ struct LINE : public PRIMITIVE
     virtual double getPositiveDelta(TERMINAL t) override;
     virtual double getNegativeDelta(TERMINAL t) override;
 
+    virtual void getBoundingBox(PTERMINAL mn, PTERMINAL mx) const override;
     virtual void doOffsetOperation() override;
     virtual void swapTerminals() override;
     virtual void write2Stream(FILE *pFile) const override;
-	virtual void readFromStream(FILE *pFile) const override;
+	virtual void readFromStream(FILE *pFile) override;
+
+private:
+    bool getClone(const TERMINAL &p, LINE *ret) const;
+    bool getClone(const TERMINAL &p1, const TERMINAL &p2, LINE *ret) const;
+    void getOffset(double offset, LINE *ret) const;
 };
@@ -0,0 +1,395 @@
+#include "offset.h"
+#include "arc.h"
+#include "boolean.h"
+#include "broadphase.h"
+#include "global.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// A step stops this far short of the distance at which the shapes would
+// touch, so they still meet within the same tenth as with fixed steps.
+static const double STEP_MARGIN = 0.9;
+
+// Steps are whole multiples of the distance over MAX_STEPS, the fixed step
+// every offset took before, which they fall back to whenever a longer one
+// cannot be shown to end where that many fixed steps would.
+static const int MAX_STEPS = 10;
+
+// Unit direction in which offsetting pr by r moves its point q.
+static VERTEX GetOffsetNormal(const PRIMITIVE *pr, const TERMINAL &q, double r)
+{
+    VERTEX v;
+    if (pr->nKind == GBAPY_ARC) {
+        v = VERTEX(q.x - pr->center.x, q.y - pr->center.y, 0);
+        if (!pr->isConvex()) r = -r;
+    }
+    else {
+        v = VERTEX(pr->terms[1].x - pr->terms[0].x, pr->terms[1].y - pr->terms[0].y, 0);
+        v = v.crossProduct(VERTEX(0, 0, 1));
+    }
+    v.normalize();
+    if (r < 0) {
+        v.x = -v.x; v.y = -v.y;
+    }
+    return v;
+}
+
+// Point of pr nearest to t, on the arc itself rather than its circle.
+static TERMINAL GetClosestPoint(const PRIMITIVE *pr, const TERMINAL &t)
+{
+    if (pr->nKind == GBAPY_ARC) {
+        double dx = t.x - pr->center.x;
+        double dy = t.y - pr->center.y;
+        double m = sqrt(dx * dx + dy * dy);
+        if (m > EP) {
+            TERMINAL q = TERMINAL(pr->center.x + pr->radius * dx / m, pr->center.y + pr->radius * dy / m);
+            if (pr->isContainedPoint(q)) return q;
+        }
+        return t.distanceTo(pr->terms[0]) < t.distanceTo(pr->terms[1]) ? pr->terms[0] : pr->terms[1];
+    }
+    double dx = pr->terms[1].x - pr->terms[0].x;
+    double dy = pr->terms[1].y - pr->terms[0].y;
+    double len = dx * dx + dy * dy;
+    double k = len > 0 ? ((t.x - pr->terms[0].x) * dx + (t.y - pr->terms[0].y) * dy) / len : 0;
+    k = std::min(1.0, std::max(0.0, k));
+    return TERMINAL(pr->terms[0].x + dx * k, pr->terms[0].y + dy * k);
+}
+
+static void KeepCloser(const TERMINAL &p1, const TERMINAL &p2, PTERMINAL q1, PTERMINAL q2, double *mn)
+{
+    double d = p1.distanceTo(p2);
+    if (d < *mn) {
+        *mn = d;
+        *q1 = p1;
+        *q2 = p2;
+    }
+}
+
+// Closest points q1 on pr1 and q2 on pr2, which must not cross. Either one
+// of them is an endpoint or the segment between them is normal to both, so
+// only those candidates are tried.
+static double GetClosestPoints(PRIMITIVE *pr1, PRIMITIVE *pr2, PTERMINAL q1, PTERMINAL q2)
+{
+    double mn = M_INFINITE;
+
+    for (int k = 0; k < 2; k++) {
+        KeepCloser(pr1->terms[k], GetClosestPoint(pr2, pr1->terms[k]), q1, q2, &mn);
+        KeepCloser(GetClosestPoint(pr1, pr2->terms[k]), pr2->terms[k], q1, q2, &mn);
+    }
+
+    if (pr1->nKind == GBAPY_ARC && pr2->nKind == GBAPY_ARC) {
+        double dx = pr2->center.x - pr1->center.x;
+        double dy = pr2->center.y - pr1->center.y;
+        double d = sqrt(dx * dx + dy * dy);
+        if (d < EP) {
+            // concentric: the radii difference is the gap wherever they face
+            if (std::abs(pr1->radius - pr2->radius) < mn) {
+                mn = std::abs(pr1->radius - pr2->radius);
+                *q1 = pr1->terms[0];
+                *q2 = GetClosestPoint(pr2, pr1->terms[0]);
+            }
+            return mn;
+        }
+        dx /= d; dy /= d;
+        for (int s1 = -1; s1 <= 1; s1 += 2) {
+            TERMINAL p1 = TERMINAL(pr1->center.x + s1 * pr1->radius * dx, pr1->center.y + s1 * pr1->radius * dy);
+            if (!pr1->isContainedPoint(p1)) continue;
+            for (int s2 = -1; s2 <= 1; s2 += 2) {
+                TERMINAL p2 = TERMINAL(pr2->center.x + s2 * pr2->radius * dx, pr2->center.y + s2 * pr2->radius * dy);
+                if (pr2->isContainedPoint(p2)) KeepCloser(p1, p2, q1, q2, &mn);
+            }
+        }
+    }
+    else if (pr1->nKind == GBAPY_ARC || pr2->nKind == GBAPY_ARC) {
+        bool swapped = pr2->nKind == GBAPY_ARC;
+        PRIMITIVE *arc = swapped ? pr2 : pr1;
+        PRIMITIVE *line = swapped ? pr1 : pr2;
+        double lx = line->terms[1].x - line->terms[0].x;
+        double ly = line->terms[1].y - line->terms[0].y;
+        double len = lx * lx + ly * ly;
+        if (len == 0) return mn;
+        double k = ((arc->center.x - line->terms[0].x) * lx + (arc->center.y - line->terms[0].y) * ly) / len;
+        if (k < 0 || k > 1) return mn;
+        TERMINAL f = TERMINAL(line->terms[0].x + lx * k, line->terms[0].y + ly * k);
+        double dx = f.x - arc->center.x;
+        double dy = f.y - arc->center.y;
+        double d = sqrt(dx * dx + dy * dy);
+        if (d < EP) {
+            // the line runs through the center, face it square on
+            d = sqrt(len);
+            dx = -ly; dy = lx;
+        }
+        dx /= d; dy /= d;
+        for (int s = -1; s <= 1; s += 2) {
+            TERMINAL p = TERMINAL(arc->center.x + s * arc->radius * dx, arc->center.y + s * arc->radius * dy);
+            if (!arc->isContainedPoint(p)) continue;
+            if (swapped) KeepCloser(f, p, q1, q2, &mn);
+            else KeepCloser(p, f, q1, q2, &mn);
+        }
+    }
+    return mn;
+}
+
+// Unit direction in which pr runs at its end, the tangent for an arc rather
+// than the chord its end directions follow.
+static VERTEX GetForward(const PRIMITIVE *pr, int end)
+{
+    VERTEX v;
+    if (pr->nKind == GBAPY_ARC) {
+        double dx = pr->terms[end].x - pr->center.x;
+        double dy = pr->terms[end].y - pr->center.y;
+        v = pr->clockWise ? VERTEX(dy, -dx, 0) : VERTEX(-dy, dx, 0);
+    }
+    else {
+        v = VERTEX(pr->terms[1].x - pr->terms[0].x, pr->terms[1].y - pr->terms[0].y, 0);
+    }
+    v.normalize();
+    return v;
+}
+
+// Velocity of the point where the offsets of prev and pr meet, false for a
+// cusp, where that point runs off to infinity.
+static bool GetJointVelocity(const PRIMITIVE *prev, const PRIMITIVE *pr, double r, VERTEX *v)
+{
+    VERTEX na = GetOffsetNormal(prev, prev->terms[1], r);
+    VERTEX nb = GetOffsetNormal(pr, pr->terms[0], r);
+    double c = 1 + na.x * nb.x + na.y * nb.y;
+    if (c < EP) return false;
+    *v = VERTEX((na.x + nb.x) / c, (na.y + nb.y) / c, 0);
+    return true;
+}
+
+// Whether offsetting by r moves the outline of shp straight away from the
+// convex region it bounds: no corner gets trimmed, every arc grows, and the
+// outline turns once around. Such an outline grows by the same disk however
+// the distance is split, and never meets itself.
+static bool IsGrowingConvex(SHAPE *shp, double r)
+{
+    int count = (int)shp->prims.size();
+    double turn = 0;
+
+    for (int i = 0; i < count; i++) {
+        PRIMITIVE *prev = shp->prims[i == 0 ? count - 1 : i - 1].get();
+        PRIMITIVE *pr = shp->prims[i].get();
+        VERTEX v;
+        if (!GetJointVelocity(prev, pr, r, &v)) return false;
+        VERTEX a = GetForward(prev, 1);
+        VERTEX b = GetForward(pr, 0);
+        if (v.x * b.x + v.y * b.y > EP) return false;
+        turn += atan2(a.x * b.y - a.y * b.x, a.x * b.x + a.y * b.y) * 180.0f / M_PI;
+        if (pr->nKind == GBAPY_ARC) {
+            if (pr->isConvex() != (r > 0)) return false;
+            const ARC::CACHE &cache = static_cast<const ARC *>(pr)->getCache();
+            turn += cache.sweepEnd - cache.sweepStart;
+        }
+    }
+    return std::abs(std::abs(turn) - 360.0f) < 1.0f;
+}
+
+// Largest step two growing convex shapes can take before they touch, half
+// the gap between them, searched up to limit.
+static double GetPairStep(SHAPE *shp1, SHAPE *shp2, double limit, double floor)
+{
+    for (int i = 0; i < (int)shp1->prims.size() && limit > floor; i++) {
+        PRIMITIVE *pr1 = shp1->prims[i].get();
+        TERMINAL mn, mx;
+        shp1->getArray().getBoundingBox(i, &mn, &mx);
+        mn.x -= 2 * limit; mn.y -= 2 * limit;
+        mx.x += 2 * limit; mx.y += 2 * limit;
+        shp2->getTree().visit(mn, mx, [&](int j) {
+            PRIMITIVE *pr2 = shp2->prims[j].get();
+            TERMINAL q1, q2;
+            if (isConflict(pr1, pr2, &q1, &q2) != 0) limit = 0;
+            else limit = std::min(limit, GetClosestPoints(pr1, pr2, &q1, &q2) / 2);
+        });
+    }
+    return limit;
+}
+
+// Largest part of the offset r, up to its full size, that takes the shapes
+// to the same place as any finer steps would. This is only shown for shapes
+// that all grow convex, and is 0 as soon as one does not. Search stops once
+// the bound drops to floor.
+static double GetSafeStep(std::vector<SHAPE> *shapes, double r, double floor)
+{
+    std::vector<char> growing(shapes->size());
+
+    // this pass also builds every array and tree, the next one only reads them
+    ParallelFor((int)shapes->size(), [&](int i, int) {
+        SHAPE *shp = &shapes->at(i);
+        shp->getTree();
+        growing[i] = IsGrowingConvex(shp, r);
+    });
+    for (std::size_t i = 0; i < growing.size(); i++) {
+        if (!growing[i]) return 0;
+    }
+
+    double limit = std::abs(r);
+    std::vector<std::pair<int, int>> pairs;
+    FindOverlappingShapes(shapes, limit, &pairs);
+    std::vector<double> limits(pairs.size(), limit);
+    ParallelFor((int)pairs.size(), [&](int i, int) {
+        limits[i] = GetPairStep(&shapes->at(pairs[i].first), &shapes->at(pairs[i].second), limits[i], floor);
+    });
+    for (std::size_t i = 0; i < limits.size(); i++) {
+        limit = std::min(limit, limits[i]);
+    }
+    return limit;
+}
+
+// Offsets every shape by r on the worker threads. Each shape writes to its own
+// buffer, and the buffers are then joined in shape order, repeating the
+// duplicate removal a split shape runs over everything gathered so far, so
+// the result matches a serial pass whatever the thread count or scheduling.
+static void OffsetStep(std::vector<SHAPE> *shapes, double r, std::vector<ARENA> *arenas, BUDGET *budget, std::vector<SHAPE> *subShapes)
+{
+    std::vector<std::vector<SHAPE>> buffers(shapes->size());
+
+    ParallelFor((int)shapes->size(), [&](int i, int worker) {
+        if (IsSpent(budget)) return;
+        shapes->at(i).doOffsetOperation(r, &buffers[i], &arenas->at(worker), budget);
+    });
+
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        for (std::size_t j = 0; j < buffers[i].size(); j++) {
+            subShapes->push_back(std::move(buffers[i][j]));
+        }
+        if (buffers[i].size() > 0 && subShapes->size() > 1) {
+            removeDuplicated(subShapes);
+        }
+    }
+}
+
+// The distance is applied in steps, each one followed by a boolean pass, so
+// that shapes growing into each other get merged along the way. Steps are
+// tenths of the distance, and only shapes that all grow convex take several
+// tenths at once, as far as they are from touching; shapes with nothing in
+// reach are then offset in a single step.
+void OffsetShapes(std::vector<SHAPE> *shapes, double r)
+{
+    OffsetShapes(shapes, r, [](double, double) { return true; });
+}
+
+bool OffsetShapes(std::vector<SHAPE> *shapes, double r, const std::function<bool(double done, double total)> &progress)
+{
+    return OffsetShapes(shapes, r, progress, NULL) == BUDGET_OK;
+}
+
+int OffsetShapes(std::vector<SHAPE> *shapes, double r, const std::function<bool(double done, double total)> &progress, BUDGET *budget)
+{
+    BOOLEANENGINE engine;
+    std::vector<ARENA> arenas(GetThreadCount());
+    double tenth = r / MAX_STEPS;
+    int left = MAX_STEPS;
+
+    engine.setBudget(budget);
+
+    do {
+        int count = 1;
+        if (left > 1) {
+            double step = GetSafeStep(shapes, tenth * left, std::abs(tenth));
+            count = std::min(left, std::max(1, (int)(step * STEP_MARGIN / std::abs(tenth))));
+        }
+        left -= count;
+
+        std::vector<SHAPE> subShapes;
+        OffsetStep(shapes, tenth * count, &arenas, budget, &subShapes);
+        if (subShapes.size() > 0) {
+            removeDuplicated(&subShapes);
+        }
+        for (std::size_t i = 0; i < subShapes.size(); i++) {
+            shapes->push_back(std::move(subShapes[i]));
+        }
+        subShapes.clear();
+        ClearShapes(shapes);
+        engine.execute(shapes);
+        if (IsSpent(budget)) return budget->getStatus();
+        if (!progress(std::abs(tenth) * (MAX_STEPS - left), std::abs(r)) && left > 0) return BUDGET_CANCELLED;
+    } while (left > 0);
+    return BUDGET_OK;
+}
+
+static int FindRoot(std::vector<int> *parents, int i)
+{
+    while (parents->at(i) != i) {
+        parents->at(i) = parents->at(parents->at(i));
+        i = parents->at(i);
+    }
+    return i;
+}
+
+// Moves the shapes into groups that cannot touch each other while every
+// shape is offset by up to reach. The groups keep the order of the shapes.
+static void SplitRegions(std::vector<SHAPE> *shapes, double reach, std::vector<std::vector<SHAPE>> *regions)
+{
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<int> parents(shapes->size());
+    std::vector<int> slots(shapes->size(), -1);
+
+    FindOverlappingShapes(shapes, reach, &pairs);
+    for (std::size_t i = 0; i < parents.size(); i++) {
+        parents[i] = (int)i;
+    }
+    for (std::size_t i = 0; i < pairs.size(); i++) {
+        int a = FindRoot(&parents, pairs[i].first);
+        int b = FindRoot(&parents, pairs[i].second);
+        if (a != b) parents[std::max(a, b)] = std::min(a, b);
+    }
+
+    regions->clear();
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        int root = FindRoot(&parents, (int)i);
+        if (slots[root] == -1) {
+            slots[root] = (int)regions->size();
+            regions->push_back(std::vector<SHAPE>());
+        }
+        regions->at(slots[root]).push_back(std::move(shapes->at(i)));
+    }
+    shapes->clear();
+}
+
+int OffsetRings(const std::vector<SHAPE> &shapes, const std::vector<double> &distances, std::vector<std::vector<SHAPE>> *rings, BUDGET *budget)
+{
+    std::vector<std::vector<SHAPE>> regions(1, shapes);
+    double done = 0;
+
+    rings->clear();
+    for (std::size_t k = 0; k < distances.size(); k++) {
+        double step = distances[k] - done;
+        done = distances[k];
+
+        // with several regions each one gets a worker, and the loops inside
+        // OffsetShapes run serially on it
+        ParallelFor((int)regions.size(), [&](int i, int) {
+            OffsetShapes(&regions[i], step, [](double, double) { return true; }, budget);
+        });
+        if (IsSpent(budget)) return budget->getStatus();
+
+        std::vector<SHAPE> ring;
+        for (std::size_t i = 0; i < regions.size(); i++) {
+            for (std::size_t j = 0; j < regions[i].size(); j++) {
+                ring.push_back(std::move(regions[i][j]));
+            }
+        }
+        if (ring.size() == 0) break;
+        rings->push_back(ring);
+
+        double reach = 0;
+        for (std::size_t j = k + 1; j < distances.size(); j++) {
+            reach = std::max(reach, std::abs(distances[j] - done));
+        }
+        SplitRegions(&ring, reach, &regions);
+    }
+    return BUDGET_OK;
+}
+
+int OffsetRings(const std::vector<SHAPE> &shapes, double stride, int count, std::vector<std::vector<SHAPE>> *rings, BUDGET *budget)
+{
+    std::vector<double> distances;
+    for (int k = 1; k <= count; k++) {
+        distances.push_back(stride * k);
+    }
+    return OffsetRings(shapes, distances, rings, budget);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "shape.h"
+
+#include <functional>
+#include <vector>
+
+void OffsetShapes(std::vector<SHAPE> *shapes, double r);
+
+// The same, calling progress(done, total) after every pass with the
+// distance offset so far out of |r|. Once progress returns false no further
+// pass starts and false is returned, leaving shapes part way offset.
+bool OffsetShapes(std::vector<SHAPE> *shapes, double r, const std::function<bool(double done, double total)> &progress);
+
+// The same with every pass, its boolean merge included, charged to budget,
+// which the caller starts. Returns BUDGET_OK, or BUDGET_CANCELLED when
+// progress returned false; otherwise the budget's status once it is spent,
+// with shapes left in no useful state.
+int OffsetShapes(std::vector<SHAPE> *shapes, double r, const std::function<bool(double done, double total)> &progress, BUDGET *budget);
+
+// Concentric rings for contour-parallel pocketing: rings->at(k) holds the
+// shapes offset by distances[k]. Each ring is offset from the one before,
+// so the distances should grow in size in one direction. Regions that can
+// no longer reach each other are offset on their own threads, and there
+// are fewer rings than distances when everything vanished before the end.
+// Every ring is charged to budget, NULL for none, and the first one that
+// spends it is dropped: the status is returned with rings holding those
+// finished before, BUDGET_OK when all were.
+int OffsetRings(const std::vector<SHAPE> &shapes, const std::vector<double> &distances, std::vector<std::vector<SHAPE>> *rings, BUDGET *budget);
+
+// The same for the distances stride, 2 * stride, ... count * stride.
+int OffsetRings(const std::vector<SHAPE> &shapes, double stride, int count, std::vector<std::vector<SHAPE>> *rings, BUDGET *budget);
@@ -0,0 +1,74 @@
+#include "pointgrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Cells are indexed with 32 bits per axis; points further out than that
+// share the outermost cells, which only makes those cells longer.
+static const double MAX_CELL = 2147483647.0;
+
+POINTGRID::POINTGRID() {
+    m_cell = 1.0;
+}
+
+void POINTGRID::clear() {
+    m_entries.clear();
+    m_points.clear();
+}
+
+std::int64_t POINTGRID::getCell(double v) const {
+    double c = std::floor(v / m_cell);
+    if (!(c > -MAX_CELL)) c = -MAX_CELL;
+    if (c > MAX_CELL) c = MAX_CELL;
+    return static_cast<std::int64_t>(c);
+}
+
+std::int64_t POINTGRID::getKey(std::int64_t cx, std::int64_t cy) {
+    return cx * 4294967296LL + (cy + 2147483648LL);
+}
+
+void POINTGRID::build(const std::vector<TERMINAL> &points, double cell) {
+    this->clear();
+    m_cell = cell > 0 ? cell : 1.0;
+    m_points = points;
+    m_entries.reserve(points.size());
+    for (std::size_t i = 0; i < points.size(); i++) {
+        if (!std::isfinite(points[i].x) || !std::isfinite(points[i].y)) continue;
+        ENTRY e;
+        e.key = getKey(getCell(points[i].x), getCell(points[i].y));
+        e.index = static_cast<int>(i);
+        m_entries.push_back(e);
+    }
+    std::sort(m_entries.begin(), m_entries.end(), [](const ENTRY &a, const ENTRY &b) {
+        return a.key < b.key || (a.key == b.key && a.index < b.index);
+    });
+}
+
+bool POINTGRID::findNearest(const TERMINAL &p, double radius, TERMINAL *ret) const {
+    if (m_entries.empty()) return false;
+
+    std::int64_t x0 = getCell(p.x - radius);
+    std::int64_t x1 = getCell(p.x + radius);
+    std::int64_t y0 = getCell(p.y - radius);
+    std::int64_t y1 = getCell(p.y + radius);
+    double mn = radius;
+    int found = -1;
+
+    for (std::int64_t cx = x0; cx <= x1; cx++) {
+        for (std::int64_t cy = y0; cy <= y1; cy++) {
+            std::int64_t key = getKey(cx, cy);
+            auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key,
+                [](const ENTRY &e, std::int64_t k) { return e.key < k; });
+            for (; it != m_entries.end() && it->key == key; ++it) {
+                double d = m_points[it->index].distanceTo(p);
+                if (d < mn || (d == mn && found >= 0 && it->index < found)) {
+                    mn = d;
+                    found = it->index;
+                }
+            }
+        }
+    }
+    if (found < 0) return false;
+    *ret = m_points[found];
+    return true;
+}
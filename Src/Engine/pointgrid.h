@@ -0,0 +1,36 @@
+#pragma once
+
+#include "terminal.h"
+
+#include <cstdint>
+#include <vector>
+
+// Uniform grid over a set of points for fixed-radius nearest queries. Each
+// point is filed under the square cell that holds it; cells are kept as
+// runs of one sorted array, so the grid has to be rebuilt whenever the
+// points change.
+struct POINTGRID
+{
+    POINTGRID();
+
+    void build(const std::vector<TERMINAL> &points, double cell);
+    void clear();
+
+    // Finds the point closest to p within radius. Ties go to the point that
+    // comes first in the array the grid was built from.
+    bool findNearest(const TERMINAL &p, double radius, TERMINAL *ret) const;
+
+private:
+    struct ENTRY
+    {
+        std::int64_t key;
+        int index;
+    };
+
+    std::int64_t getCell(double v) const;
+    static std::int64_t getKey(std::int64_t cx, std::int64_t cy);
+
+    std::vector<ENTRY> m_entries;
+    std::vector<TERMINAL> m_points;
+    double m_cell;
+};
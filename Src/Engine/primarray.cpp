@@ -0,0 +1,132 @@
+#include "primarray.h"
+#include "global.h"
+
+PRIMITIVEARRAY::PRIMITIVEARRAY() {
+    m_built = false;
+}
+
+void PRIMITIVEARRAY::clear() {
+    m_kinds.clear();
+    m_x0.clear();
+    m_y0.clear();
+    m_x1.clear();
+    m_y1.clear();
+    m_cx.clear();
+    m_cy.clear();
+    m_radius.clear();
+    m_startAngle.clear();
+    m_endAngle.clear();
+    m_clockWise.clear();
+    m_convex.clear();
+    m_minX.clear();
+    m_minY.clear();
+    m_maxX.clear();
+    m_maxY.clear();
+    m_arcCache.clear();
+    m_built = false;
+}
+
+bool PRIMITIVEARRAY::isBuilt(std::size_t count) const {
+    return m_built && m_kinds.size() == count;
+}
+
+void PRIMITIVEARRAY::build(const std::vector<std::unique_ptr<PRIMITIVE>> &prims) {
+    std::size_t n = prims.size();
+
+    this->clear();
+    m_kinds.resize(n);
+    m_x0.resize(n);
+    m_y0.resize(n);
+    m_x1.resize(n);
+    m_y1.resize(n);
+    m_cx.resize(n);
+    m_cy.resize(n);
+    m_radius.resize(n);
+    m_startAngle.resize(n, 0);
+    m_endAngle.resize(n, 0);
+    m_clockWise.resize(n);
+    m_convex.resize(n);
+    m_minX.resize(n);
+    m_minY.resize(n);
+    m_maxX.resize(n);
+    m_maxY.resize(n);
+    m_arcCache.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+        const PRIMITIVE *pr = prims[i].get();
+        TERMINAL mn, mx;
+
+        m_kinds[i] = pr->nKind;
+        m_x0[i] = pr->terms[0].x;
+        m_y0[i] = pr->terms[0].y;
+        m_x1[i] = pr->terms[1].x;
+        m_y1[i] = pr->terms[1].y;
+        m_cx[i] = pr->center.x;
+        m_cy[i] = pr->center.y;
+        m_radius[i] = pr->radius;
+        m_clockWise[i] = pr->clockWise;
+        m_convex[i] = pr->isConvex();
+        if (pr->nKind == GBAPY_ARC) {
+            const ARC *arc = static_cast<const ARC*>(pr);
+            m_startAngle[i] = arc->startAngle;
+            m_endAngle[i] = arc->endAngle;
+            m_arcCache[i] = arc->getCache();
+        }
+        pr->getBoundingBox(&mn, &mx);
+        m_minX[i] = mn.x;
+        m_minY[i] = mn.y;
+        m_maxX[i] = mx.x;
+        m_maxY[i] = mx.y;
+    }
+    m_built = true;
+}
+
+void PRIMITIVEARRAY::getBoundingBox(int i, PTERMINAL mn, PTERMINAL mx) const {
+    *mn = TERMINAL(m_minX[i], m_minY[i]);
+    *mx = TERMINAL(m_maxX[i], m_maxY[i]);
+}
+
+double PRIMITIVEARRAY::getOffsetRadius(int i, double offset) const {
+    if (m_kinds[i] != GBAPY_ARC) return M_INFINITE;
+    return m_convex[i] ? m_radius[i] + offset : m_radius[i] - offset;
+}
+
+bool PRIMITIVEARRAY::isRayCandidate(int i, const TERMINAL &p, const VERTEX &dir) const {
+    // The boxes already carry a margin, this one covers the ray itself.
+    const double margin = EP * 10;
+    const double xs[2] = { m_minX[i] - p.x, m_maxX[i] - p.x };
+    const double ys[2] = { m_minY[i] - p.y, m_maxY[i] - p.y };
+    int left = 0;
+    int right = 0;
+    int behind = 0;
+
+    for (int a = 0; a < 2; a++) {
+        for (int b = 0; b < 2; b++) {
+            double side = dir.x * ys[b] - dir.y * xs[a];
+            if (side > margin) left++;
+            else if (side < -margin) right++;
+            if (dir.x * xs[a] + dir.y * ys[b] < -margin) behind++;
+        }
+    }
+    return left < 4 && right < 4 && behind < 4;
+}
+
+PRIMITIVE *PRIMITIVEARRAY::view(int i) {
+    PRIMITIVE *pr;
+
+    if (m_kinds[i] == GBAPY_ARC) {
+        m_arc.startAngle = m_startAngle[i];
+        m_arc.endAngle = m_endAngle[i];
+        m_arc.setCache(m_arcCache[i]);
+        pr = &m_arc;
+    }
+    else {
+        pr = &m_line;
+    }
+    pr->terms[0] = TERMINAL(m_x0[i], m_y0[i]);
+    pr->terms[1] = TERMINAL(m_x1[i], m_y1[i]);
+    pr->center = TERMINAL(m_cx[i], m_cy[i]);
+    pr->radius = m_radius[i];
+    pr->clockWise = m_clockWise[i] != 0;
+    pr->isValid = true;
+    return pr;
+}
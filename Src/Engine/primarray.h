@@ -0,0 +1,65 @@
+#pragma once
+
+#include "arc.h"
+#include "line.h"
+#include "primitive.h"
+#include "terminal.h"
+
+#include <memory>
+#include <vector>
+
+// Structure-of-arrays copy of the primitives of one shape: one column per
+// field, so loops that only need endpoints, boxes or radii read contiguous
+// memory instead of following a pointer and a vtable per primitive. Like
+// the BVH it mirrors the shape's primitives by index and has to be rebuilt
+// once they are added, removed, reordered or moved.
+struct PRIMITIVEARRAY
+{
+    PRIMITIVEARRAY();
+
+    void build(const std::vector<std::unique_ptr<PRIMITIVE>> &prims);
+    void clear();
+
+    bool isBuilt(std::size_t count) const;
+    int getCount() const { return static_cast<int>(m_kinds.size()); }
+
+    int getKind(int i) const { return m_kinds[i]; }
+    TERMINAL getStart(int i) const { return TERMINAL(m_x0[i], m_y0[i]); }
+    TERMINAL getEnd(int i) const { return TERMINAL(m_x1[i], m_y1[i]); }
+    void getBoundingBox(int i, PTERMINAL mn, PTERMINAL mx) const;
+
+    // The radius tryOffset(offset) would give primitive i, without building
+    // the offset primitive. Lines keep M_INFINITE.
+    double getOffsetRadius(int i, double offset) const;
+
+    // False when the box of primitive i lies entirely on one side of the ray
+    // from p along the unit direction dir, or behind p.
+    bool isRayCandidate(int i, const TERMINAL &p, const VERTEX &dir) const;
+
+    // Primitive i as a LINE or ARC. The object is owned by the array and
+    // reused by the next call, so it must not be kept or modified.
+    PRIMITIVE *view(int i);
+
+private:
+    std::vector<int> m_kinds;
+    std::vector<double> m_x0;
+    std::vector<double> m_y0;
+    std::vector<double> m_x1;
+    std::vector<double> m_y1;
+    std::vector<double> m_cx;
+    std::vector<double> m_cy;
+    std::vector<double> m_radius;
+    std::vector<double> m_startAngle;
+    std::vector<double> m_endAngle;
+    std::vector<char> m_clockWise;
+    std::vector<char> m_convex;
+    std::vector<double> m_minX;
+    std::vector<double> m_minY;
+    std::vector<double> m_maxX;
+    std::vector<double> m_maxY;
+    std::vector<ARC::CACHE> m_arcCache;
+    bool m_built;
+
+    LINE m_line;
+    ARC m_arc;
+};
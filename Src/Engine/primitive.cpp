@@ -12,6 +12,15 @@ PRIMITIVE::PRIMITIVE() {
 
 PRIMITIVE::~PRIMITIVE() = default;
 
+void *PRIMITIVE::operator new(std::size_t size) {
+    CountAllocation();
+    return ::operator new(size);
+}
+
+void PRIMITIVE::operator delete(void *p) {
+    ::operator delete(p);
+}
+
 static int GetSharePoint(const ARC *arc, const LINE *line, TERMINAL *p1, TERMINAL *p2) {
     TERMINAL p0;
     double dist = line->getDistance(arc->center, &p0);
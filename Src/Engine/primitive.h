@@ -1,14 +1,13 @@
 #pragma once
 
+#include "arena.h"
 #include "terminal.h"
 #include "vertex.h"
 
+#include <cstdio>
 #include <memory>
 
-#include <QtGlobal>
-QT_BEGIN_NAMESPACE
-class QTextStream;
-QT_END_NAMESPACE
+struct PRIMVALUE;
 
 struct PRIMITIVE
 {
@@ -24,11 +23,31 @@ struct PRIMITIVE
     PRIMITIVE();
     virtual ~PRIMITIVE();
 
+    // Heap allocations of primitives are counted, see GetAllocationCount().
+    static void *operator new(std::size_t size);
+    static void operator delete(void *p);
+    static void *operator new(std::size_t, void *place) { return place; }
+    static void operator delete(void *, void *) {}
+
     virtual std::unique_ptr<PRIMITIVE> clone() const = 0;
     virtual std::unique_ptr<PRIMITIVE> clone(const TERMINAL &p) const = 0;
     virtual std::unique_ptr<PRIMITIVE> clone(const TERMINAL &p1, const TERMINAL &p2) const = 0;
     virtual std::unique_ptr<PRIMITIVE> tryOffset(double offset) const = 0;
 
+    // The same, placed in an arena. The results live until the arena is
+    // reset and must not be deleted.
+    virtual PRIMITIVE *clone(ARENA *arena) const = 0;
+    virtual PRIMITIVE *clone(const TERMINAL &p, ARENA *arena) const = 0;
+    virtual PRIMITIVE *clone(const TERMINAL &p1, const TERMINAL &p2, ARENA *arena) const = 0;
+    virtual PRIMITIVE *tryOffset(double offset, ARENA *arena) const = 0;
+
+    // The same by value, for results that are only inspected. The value is
+    // empty where the unique_ptr variants return NULL.
+    virtual PRIMVALUE cloneValue() const = 0;
+    virtual PRIMVALUE cloneValue(const TERMINAL &p) const = 0;
+    virtual PRIMVALUE cloneValue(const TERMINAL &p1, const TERMINAL &p2) const = 0;
+    virtual PRIMVALUE tryOffsetValue(double offset) const = 0;
+
     virtual bool hasSamePivot(const TERMINAL &p, PTERMINAL ret) = 0;
     virtual bool hasSamePivot(const TERMINAL &p) = 0;
     virtual bool isConvex() const = 0;
@@ -40,10 +59,11 @@ struct PRIMITIVE
     virtual VERTEX getNegativeDirection() const = 0;
     virtual VERTEX getTangent(TERMINAL p) const = 0;
 
+    virtual void getBoundingBox(PTERMINAL mn, PTERMINAL mx) const = 0;
     virtual void doOffsetOperation() = 0;
     virtual void swapTerminals() = 0;
     virtual void write2Stream(FILE *pFile) const = 0;
-	virtual void readFromStream(FILE *pFile) const = 0;
+	virtual void readFromStream(FILE *pFile) = 0;
 
     virtual double getDistance(TERMINAL t, PTERMINAL ret) const = 0;
     virtual double getPositiveDelta(TERMINAL t) = 0;
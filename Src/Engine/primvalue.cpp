@@ -0,0 +1,64 @@
+#include "primvalue.h"
+#include "global.h"
+
+PRIMVALUE::PRIMVALUE() {
+    m_kind = 0;
+}
+
+PRIMVALUE::PRIMVALUE(const LINE &line) {
+    new (&m_line) LINE(line);
+    m_kind = GBAPY_LINE;
+}
+
+PRIMVALUE::PRIMVALUE(const ARC &arc) {
+    new (&m_arc) ARC(arc);
+    m_kind = GBAPY_ARC;
+}
+
+PRIMVALUE::PRIMVALUE(const PRIMVALUE &value) {
+    m_kind = 0;
+    this->assign(value);
+}
+
+PRIMVALUE::~PRIMVALUE() {
+    this->destroy();
+}
+
+PRIMVALUE &PRIMVALUE::operator=(const PRIMVALUE &value) {
+    if (this != &value) {
+        this->destroy();
+        this->assign(value);
+    }
+    return *this;
+}
+
+// Builds a copy of whatever value holds in the slot, which must be empty.
+void PRIMVALUE::assign(const PRIMVALUE &value) {
+    if (value.m_kind == GBAPY_LINE) new (&m_line) LINE(value.m_line);
+    else if (value.m_kind == GBAPY_ARC) new (&m_arc) ARC(value.m_arc);
+    m_kind = value.m_kind;
+}
+
+void PRIMVALUE::destroy() {
+    if (m_kind == GBAPY_LINE) m_line.~LINE();
+    else if (m_kind == GBAPY_ARC) m_arc.~ARC();
+    m_kind = 0;
+}
+
+PRIMITIVE *PRIMVALUE::get() {
+    if (m_kind == GBAPY_LINE) return &m_line;
+    if (m_kind == GBAPY_ARC) return &m_arc;
+    return NULL;
+}
+
+const PRIMITIVE *PRIMVALUE::get() const {
+    if (m_kind == GBAPY_LINE) return &m_line;
+    if (m_kind == GBAPY_ARC) return &m_arc;
+    return NULL;
+}
+
+std::unique_ptr<PRIMITIVE> PRIMVALUE::toUnique() const {
+    if (m_kind == GBAPY_LINE) return std::unique_ptr<PRIMITIVE>(new LINE(m_line));
+    if (m_kind == GBAPY_ARC) return std::unique_ptr<PRIMITIVE>(new ARC(m_arc));
+    return NULL;
+}
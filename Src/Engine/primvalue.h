@@ -0,0 +1,41 @@
+#pragma once
+
+#include "arc.h"
+#include "line.h"
+
+#include <memory>
+
+// A LINE or an ARC held by value, or nothing when the operation that made
+// it failed. Meant for primitives that are only looked at and dropped, so
+// they never touch the heap; toUnique() makes an owned copy when one has to
+// be kept. Both share one slot, and only the one m_kind names is alive.
+struct PRIMVALUE
+{
+    PRIMVALUE();
+    explicit PRIMVALUE(const LINE &line);
+    explicit PRIMVALUE(const ARC &arc);
+    PRIMVALUE(const PRIMVALUE &value);
+    ~PRIMVALUE();
+
+    PRIMVALUE &operator=(const PRIMVALUE &value);
+
+    bool hasValue() const { return m_kind != 0; }
+
+    PRIMITIVE *get();
+    const PRIMITIVE *get() const;
+    PRIMITIVE *operator->() { return this->get(); }
+    const PRIMITIVE *operator->() const { return this->get(); }
+
+    std::unique_ptr<PRIMITIVE> toUnique() const;
+
+private:
+    void assign(const PRIMVALUE &value);
+    void destroy();
+
+    int m_kind;
+    union
+    {
+        LINE m_line;
+        ARC m_arc;
+    };
+};
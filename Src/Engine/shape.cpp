@@ -3,8 +3,9 @@
 #include "global.h"
 #include "line.h"
 #include "primitive.h"
+#include "primvalue.h"
 
-#include <QTextStream>
+#include <algorithm>
 
 SHAPE::SHAPE() {
     this->prims.clear();
@@ -30,6 +31,11 @@ SHAPE & SHAPE::operator=(const SHAPE &other) {
     this->isIntersected = other.isIntersected;
     this->isCompleted = other.isCompleted;
     this->isPositive = other.isPositive;
+    this->primTree = other.primTree;
+    this->primArray = other.primArray;
+    this->hasBox = other.hasBox;
+    this->boxMin = other.boxMin;
+    this->boxMax = other.boxMax;
     return *this;
 }
 
@@ -44,9 +50,68 @@ SHAPE* SHAPE::clone() {
     shp->isIntersected = this->isIntersected;
     shp->isCompleted = this->isCompleted;
     shp->isPositive = this->isPositive;
+    shp->hasBox = this->hasBox;
+    shp->boxMin = this->boxMin;
+    shp->boxMax = this->boxMax;
     return shp;
 }
 
+// The array and the tree are built on first use and dropped by
+// invalidate(); as a safety net they are also rebuilt when the primitive
+// count no longer matches.
+PRIMITIVEARRAY &SHAPE::getArray() {
+    if (!this->primArray.isBuilt(this->prims.size())) {
+        this->primArray.build(this->prims);
+    }
+    return this->primArray;
+}
+
+const BVH &SHAPE::getTree() {
+    if (!this->primTree.isBuilt(this->prims.size())) {
+        this->primTree.build(this->getArray());
+    }
+    return this->primTree;
+}
+
+void SHAPE::invalidate() {
+    this->primTree.clear();
+    this->primArray.clear();
+    this->hasBox = false;
+}
+
+void SHAPE::updateBoundingBox() {
+    this->hasBox = false;
+    for (std::size_t i = 0; i < this->prims.size(); i++) {
+        TERMINAL mn, mx;
+        this->prims[i]->getBoundingBox(&mn, &mx);
+        if (this->hasBox == false) {
+            this->boxMin = mn;
+            this->boxMax = mx;
+            this->hasBox = true;
+        }
+        else{
+            mn.ensureRectContains(&this->boxMin, &this->boxMax);
+            mx.ensureRectContains(&this->boxMin, &this->boxMax);
+        }
+    }
+}
+
+// The box is worked out by update() and recomputed on demand after any
+// change that called invalidate(); it is false only for an empty shape.
+bool SHAPE::getBoundingBox(PTERMINAL mn, PTERMINAL mx) {
+    if (this->hasBox == false) this->updateBoundingBox();
+    if (this->hasBox == false) return false;
+    *mn = this->boxMin;
+    *mx = this->boxMax;
+    return true;
+}
+
+bool SHAPE::isBoxOverlapped(SHAPE *shp) {
+    TERMINAL mn1, mx1, mn2, mx2;
+    if (!this->getBoundingBox(&mn1, &mx1) || !shp->getBoundingBox(&mn2, &mx2)) return false;
+    return mn1.x <= mx2.x && mn2.x <= mx1.x && mn1.y <= mx2.y && mn2.y <= mx1.y;
+}
+
 int SHAPE::findFrozenTerm()
 {
     for (std::size_t i = 0; i < this->prims.size(); i++) {
@@ -71,15 +136,13 @@ int SHAPE::findFrozenTerm()
 
 int SHAPE::findFrozenPrimitive() {
     for (std::size_t i = 0; i < this->prims.size(); i++) {
-        std::unique_ptr<PRIMITIVE> pr = this->prims[i]->clone();
+        PRIMVALUE pr = this->prims[i]->cloneValue();
         TERMINAL t;
         int index;
 
         if (this->getSelfIntersection(i, pr.get(), &t, &index) == true) {
-            pr.reset(nullptr);
             return i;
         }
-        pr.reset(nullptr);
     }
     return -1;
 }
@@ -89,56 +152,40 @@ bool SHAPE::getSelfIntersection(int index, PRIMITIVE *pr, PTERMINAL ret, int *re
     bool flag = false;
     double mn = 0;
     int n0 = index;
-    int n1 = n0 >= 0 && n0 < (int)(this->prims.size()) ? index + 1 : -1;
-    int n2 = n0 >= 0 && n0 < (int)(this->prims.size()) ? index - 1 : -1;
-    if (n0 >= 0 && n0 < (int)(this->prims.size())) {
-        if (n1 == static_cast<int>(this->prims.size())) n1 = 0;
-        if (n2 < 0) n2 = static_cast<int>(this->prims.size()) - 1;
-    }
-    for (std::size_t i = 0; i < this->prims.size(); i++) {
-        if (n0 == static_cast<int>(i)) continue;
+    TERMINAL bmn, bmx;
+
+    // Only primitives whose boxes overlap pr can cross it. They are visited
+    // in tree order, so ties on the distance go to the lower index, which is
+    // what a plain scan over prims would pick.
+    pr->getBoundingBox(&bmn, &bmx);
+    this->getTree().visit(bmn, bmx, [&](int i) {
+        if (n0 == i) return;
         TERMINAL p1, p2;
         if (isConflict(pr, this->prims[i].get(), &p1, &p2) == 1) {
             if (p1.isValid && !(pr->terms[0].isEqual(p1)) && !(pr->terms[1].isEqual(p1)))
             {
                 double m = pr->getPositiveDelta(p1);
-                if (flag == false) {
+                if (flag == false || m < mn || (m == mn && i < *retIndex)) {
                     flag = true;
                     mn = m;
                     ret->x = p1.x;
                     ret->y = p1.y;
                     *retIndex = i;
                 }
-                else{
-                    if (m < mn) {
-                        ret->x = p1.x;
-                        ret->y = p1.y;
-                        *retIndex = i;
-                        mn = m;
-                    }
-                }
             }
             if (p2.isValid && !(pr->terms[0].isEqual(p2)) && !(pr->terms[1].isEqual(p2)))
             {
                 double m = pr->getPositiveDelta(p2);
-                if (flag == false) {
+                if (flag == false || m < mn || (m == mn && i < *retIndex)) {
                     flag = true;
                     mn = m;
                     ret->x = p2.x;
                     ret->y = p2.y;
                     *retIndex = i;
                 }
-                else{
-                    if (m < mn) {
-                        ret->x = p2.x;
-                        ret->y = p2.y;
-                        *retIndex = i;
-                        mn = m;
-                    }
-                }
             }
         }
-    }
+    });
     return flag;
 }
 
@@ -200,6 +247,8 @@ bool SHAPE::sortPremitives()
     for (std::size_t i = 0; i < ps.size(); i++) {
         this->prims.push_back(std::unique_ptr<PRIMITIVE>(ps[i]));
     }
+    this->primTree.clear();
+    this->primArray.clear();
 
     return true;
 }
@@ -207,6 +256,7 @@ bool SHAPE::sortPremitives()
 
 bool SHAPE::isPositiveShape() {
     VERTEX up = VERTEX(0, 0, 1);
+    PRIMITIVEARRAY &array = this->getArray();
 
     for (std::size_t i = 0; i < this->prims.size(); i++) {
         int n = (int)i - 1;
@@ -232,9 +282,12 @@ bool SHAPE::isPositiveShape() {
         double mn = M_INFINITE;
         int mnI = -1;
 
-        for (std::size_t j = 0; j < this->prims.size(); j++) {
+        // Stream over the boxes first; only primitives the ray can reach
+        // are handed to isConflict().
+        for (int j = 0; j < array.getCount(); j++) {
             TERMINAL p1, p2;
-            if (isConflict(&l1, this->prims[j].get(), &p1, &p2) == 1) {
+            if (!array.isRayCandidate(j, t, v2T)) continue;
+            if (isConflict(&l1, array.view(j), &p1, &p2) == 1) {
                 if (p1.isValid && !p1.isEqual(t)) {
                     double m = t.distanceTo(p1);
                     if (m < mn) {
@@ -277,6 +330,9 @@ void SHAPE::turnPrimitiveOut() {
     for (std::size_t i = 0; i < ps.size(); i++) {
         this->prims.push_back(std::move(ps[i]));
     }
+    // reordering only; the bounding box still holds
+    this->primTree.clear();
+    this->primArray.clear();
 }
 
 bool SHAPE::makePositive() {
@@ -288,6 +344,8 @@ bool SHAPE::makePositive() {
 }
 
 void SHAPE::update() {
+    this->invalidate();
+    this->updateBoundingBox();
     if (this->isSortedShape() == false) {
         if (!this->sortPremitives()) return;
         makePositive();
@@ -310,15 +368,11 @@ bool SHAPE::isInsidePoint(PRIMITIVE *pr, int index)
 bool SHAPE::isInsidePoint(TERMINAL p) {
     TERMINAL t;
     int index;
-    LINE *ln = new LINE(TERMINAL(p.x, p.y), TERMINAL(p.x + M_INFINITE, p.y));
-    bool ret = this->getSelfIntersection(-1, ln, &t, &index);
+    LINE ray(TERMINAL(p.x, p.y), TERMINAL(p.x + M_INFINITE, p.y));
 
-    delete ln;
-    if (ret == false) return false;
-    ln = new LINE(p, t);
-    ret = this->isInsidePoint(ln, index);
-    delete ln;
-    return ret;
+    if (this->getSelfIntersection(-1, &ray, &t, &index) == false) return false;
+    LINE ln(p, t);
+    return this->isInsidePoint(&ln, index);
 }
 
 bool SHAPE::isInsideShape(SHAPE *shp) {
@@ -330,40 +384,19 @@ bool SHAPE::isInsideShape(SHAPE *shp) {
 
 void SHAPE::insertPrimitive(std::unique_ptr<PRIMITIVE> pr, int index)
 {
-    SHAPE sp;
-
-    for (std::size_t i = 0; i < this->prims.size(); i++) {
-        if ((int)i == index) {
-            sp.prims.push_back(std::move(pr));
-        }
-        sp.prims.push_back(std::move(this->prims[i]));
-    }
-    this->prims.clear();
-    for (std::size_t i = 0; i < sp.prims.size(); i++) {
-        this->prims.push_back(std::move(sp.prims[i]));
+    // pr is dropped when index is past the last primitive
+    if (index >= 0 && (std::size_t)index < this->prims.size()) {
+        this->prims.insert(this->prims.begin() + index, std::move(pr));
     }
+    this->invalidate();
 }
 
-// TODO make this function use std::unique_ptr<PRIMITIVE> correctly
 void SHAPE::removePrimitives() {
-    //std::remove_if(prims.begin(), prims.end(), [&](const std::unique_ptr<PRIMITIVE> &prim) -> bool {
-    //    return !prim->isValid;
-    //});
-    SHAPE sp;
-
-    for (std::size_t i = 0; i < this->prims.size(); i++) {
-        if (this->prims[i]->isValid) {
-            sp.prims.push_back(std::move(this->prims[i]));
-        }
-        else{
-            this->prims[i].reset(nullptr);
-        }
-
-    }
-    this->prims.clear();
-    for (std::size_t i = 0; i < sp.prims.size(); i++) {
-        this->prims.push_back(std::move(sp.prims[i]));
-    }
+    this->prims.erase(std::remove_if(this->prims.begin(), this->prims.end(),
+        [](const std::unique_ptr<PRIMITIVE> &prim) -> bool {
+            return !prim->isValid;
+        }), this->prims.end());
+    this->invalidate();
 }
 
 
@@ -401,20 +434,31 @@ void SHAPE::clear() {
         this->prims[i].reset(nullptr);
     }
     prims.clear();
+    this->invalidate();
 }
 
 bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes) {
+    ARENA arena;
+    return this->doOffsetOperation(offsetVal, subShapes, &arena);
+}
+
+bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes, ARENA *arena) {
+    return this->doOffsetOperation(offsetVal, subShapes, arena, NULL);
+}
+
+// Pieces cut during the trimming walk come from arena, which is reset per
+// primitive, so anything the caller placed there before is gone afterwards.
+// Every step of the walk is charged to budget; once it is spent the shape
+// is left half trimmed and false is returned.
+bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes, ARENA *arena, BUDGET *budget) {
     if (this->isCompleted == false) return false;
 
     bool bPositive = this->isPositive;
     bool bCW = offsetVal > 0 ? false : true;
 
-    for (std::size_t i = 0; i < this->prims.size(); i++) {
-        this->prims[i]->isValid = true;
-        std::unique_ptr<PRIMITIVE> pr1 = this->prims[i]->tryOffset(offsetVal);
-        if (pr1->radius < EP)
-            this->prims[i]->isValid = false;
-        pr1.reset(nullptr);
+    PRIMITIVEARRAY &array = this->getArray();
+    for (int i = 0; i < array.getCount(); i++) {
+        this->prims[i]->isValid = array.getOffsetRadius(i, offsetVal) >= EP;
     }
 
     for (std::size_t i = 0; i < this->prims.size(); i++) {
@@ -435,8 +479,8 @@ bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes) {
     for (std::size_t i = 0; i < this->prims.size(); i++) {
         int n = (int)i - 1;
         if (n < 0) n = this->prims.size() - 1;
-        std::unique_ptr<PRIMITIVE> pr1 = this->prims[i]->tryOffset(offsetVal);
-        std::unique_ptr<PRIMITIVE> pr2 = this->prims[n]->tryOffset(offsetVal);
+        PRIMVALUE pr1 = this->prims[i]->tryOffsetValue(offsetVal);
+        PRIMVALUE pr2 = this->prims[n]->tryOffsetValue(offsetVal);
 
         TERMINAL p1, p2;
         int ret = GetSharePoint(pr1.get(), pr2.get(), &p1, &p2);
@@ -460,8 +504,6 @@ bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes) {
         this->prims[n]->offsets[1] = p2;
         this->prims[i]->offRadius = pr1->radius;
         this->prims[n]->offRadius = pr2->radius;
-        pr1.reset(nullptr);
-        pr2.reset(nullptr);
     }
 
     for (std::size_t i = 0; i < this->prims.size(); i++) {
@@ -481,8 +523,8 @@ bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes) {
         if (this->prims[i]->isValid == false) continue;
         int n = i - 1;
         if (n == -1) n = this->prims.size() - 1;
-        std::unique_ptr<PRIMITIVE> pr1 = this->prims[i]->tryOffset(offsetVal);
-        std::unique_ptr<PRIMITIVE> pr2 = this->prims[n]->tryOffset(offsetVal);
+        PRIMVALUE pr1 = this->prims[i]->tryOffsetValue(offsetVal);
+        PRIMVALUE pr2 = this->prims[n]->tryOffsetValue(offsetVal);
 
         TERMINAL p1, p2;
 
@@ -524,8 +566,6 @@ bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes) {
         this->prims[n]->offsets[1] = p2;
         this->prims[i]->offRadius = pr1->radius;
         this->prims[n]->offRadius = pr2->radius;
-        pr1.reset(nullptr);
-        pr2.reset(nullptr);
     }
 
     for (std::size_t i = 0; i < this->prims.size(); i++) {
@@ -536,37 +576,38 @@ bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes) {
             this->prims[i]->doOffsetOperation();
         }
     }
+    this->invalidate();
 
     for (std::size_t i = 0; i < this->prims.size(); i++) {
-        std::unique_ptr<PRIMITIVE> pr = this->prims[i]->clone();
+        arena->reset();
+        PRIMVALUE pr = this->prims[i]->cloneValue();
         TERMINAL t;
         int index;
 
-        if (pr == NULL) continue;
+        if (!pr.hasValue()) continue;
         while (this->getSelfIntersection(i, pr.get(), &t, &index)) {
             SHAPE tshp;
             TERMINAL st = pr->terms[0];
             TERMINAL et = t;
-            std::unique_ptr<PRIMITIVE> prim = this->prims[i]->clone(st, et);
-
-            pr.reset(nullptr);
+            PRIMITIVE *prim = this->prims[i]->clone(st, et, arena);
 
+            if (!Charge(budget, 0)) return false;
 			if (prim == NULL) break;
-            if (this->isInsidePoint(prim.get(), index) != bCW) {
-                prim.reset(nullptr);
-                pr = this->prims[i]->clone(et);
-                if(pr == NULL) break;
+            if (this->isInsidePoint(prim, index) != bCW) {
+                pr = this->prims[i]->cloneValue(et);
+                if (!pr.hasValue()) break;
                 continue;
             }
 
             this->isValid = false;
-            tshp.prims.push_back(std::move(prim));
+            tshp.prims.push_back(prim->clone());
             while (true)
             {
+                if (!Charge(budget, 1)) return false;
                 int m = index;
-                std::unique_ptr<PRIMITIVE> pr1 = this->prims[index]->clone(t);
+                PRIMITIVE *pr1 = this->prims[index]->clone(t, arena);
                 if (pr1 == NULL) break;
-                if (this->getSelfIntersection(m, pr1.get(), &t, &index)) {
+                if (this->getSelfIntersection(m, pr1, &t, &index)) {
 					std::unique_ptr<PRIMITIVE> pr2 = pr1->clone(pr1->terms[0], t);
 					if (pr2 == NULL) break;
                     tshp.prims.push_back(std::move(pr2));
@@ -578,20 +619,18 @@ bool SHAPE::doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes) {
                     if ((std::size_t)index >= this->prims.size()) index = 0;
                     t = pr1->terms[1];
                 }
-                pr1.reset(nullptr);
                 if (t.isEqual(st)) break;
             }
             tshp.update();
 			if (tshp.isCompleted)
-				subShapes->push_back(tshp);
+				subShapes->push_back(std::move(tshp));
 			else {
 				tshp.clear();
 				tshp.prims.clear();
 			}
-            pr = this->prims[i]->clone(et);
-            if (pr == NULL) break;
+            pr = this->prims[i]->cloneValue(et);
+            if (!pr.hasValue()) break;
         }
-        if(pr != NULL) pr.reset(nullptr);
     }
 
     if (this->isValid) {
@@ -622,19 +661,8 @@ void removeDuplicated(std::vector<SHAPE> *subShapes) {
 }
 
 void ClearShapes(std::vector<SHAPE> *subShapes) {
-    std::vector<SHAPE> shps;
-
-    for (std::size_t i = 0; i < subShapes->size(); i++) {
-        if (subShapes->at(i).isValid == false) {
-            subShapes->at(i).clear();
-        }
-        else{
-            shps.push_back(subShapes->at(i));
-        }
-    }
-    subShapes->clear();
-    for (std::size_t i = 0; i < shps.size(); i++) {
-        subShapes->push_back(shps[i]);
-    }
-    shps.clear();
+    subShapes->erase(std::remove_if(subShapes->begin(), subShapes->end(),
+        [](const SHAPE &shp) -> bool {
+            return shp.isValid == false;
+        }), subShapes->end());
 }
@@ -1,22 +1,25 @@
 #pragma once
 
+#include "budget.h"
+#include "bvh.h"
+#include "primarray.h"
 #include "primitive.h"
 
 #include <vector>
 
-#include <QtGlobal>
-QT_BEGIN_NAMESPACE
-class QTextStream;
-QT_END_NAMESPACE
-
 struct SHAPE
 {
     bool isValid = true;
     bool isIntersected = true;
     bool isCompleted = false;
     bool isPositive = false;
+    bool hasBox = false;
 
     std::vector<std::unique_ptr<PRIMITIVE>> prims;
+    BVH primTree;
+    PRIMITIVEARRAY primArray;
+    TERMINAL boxMin;
+    TERMINAL boxMax;
 
     SHAPE();
     SHAPE(const SHAPE &other);
@@ -25,6 +28,13 @@ struct SHAPE
     SHAPE & operator=(SHAPE &&other);
     SHAPE *clone();
 
+    const BVH &getTree();
+    PRIMITIVEARRAY &getArray();
+    void invalidate();
+    void updateBoundingBox();
+    bool getBoundingBox(PTERMINAL mn, PTERMINAL mx);
+    bool isBoxOverlapped(SHAPE *shp);
+
     int findFrozenPrimitive();
     int findFrozenTerm();
 
@@ -37,6 +47,8 @@ struct SHAPE
     bool getSelfIntersection(int index, PRIMITIVE *pr, PTERMINAL ret, int *retIndex);
     bool isPositiveShape();
     bool doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes);
+    bool doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes, ARENA *arena);
+    bool doOffsetOperation(double offsetVal, std::vector<SHAPE> *subShapes, ARENA *arena, BUDGET *budget);
 
     void turnPrimitiveOut();
     void insertPrimitive(std::unique_ptr<PRIMITIVE> pr, int index);
@@ -0,0 +1,964 @@
+#include "shapefile.h"
+#include "arc.h"
+#include "global.h"
+#include "line.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SHAPEFILE_MAGIC[8] = { 'G', 'B', 'A', 'P', 'Y', 'S', 'H', 'P' };
+
+// Records are written this many at a time.
+static const std::size_t WRITE_CHUNK = 4096;
+
+static_assert(sizeof(SHAPEFILEHEADER) == 48, "SHAPEFILEHEADER must stay packed");
+static_assert(sizeof(PRIMRECORD) == 80, "PRIMRECORD must stay packed");
+static_assert(sizeof(COMPACTHEADER) == 40, "COMPACTHEADER must stay packed");
+
+// Flags in the low bits of the first varint of a compact edge.
+enum _COMPACT_EDGE_
+{
+    COMPACT_ARC = 1,
+    COMPACT_JUMP = 2
+};
+
+// Snapped coordinates stay below 2^52 grid steps, so the step between two
+// of them still fits a varint once zigzagged and shifted past the flags.
+static const double COMPACT_LIMIT = 4503599627370496.0;
+
+// Bulges are fixed point with 32 fractional bits, as a shallow arc's
+// centre moves by the chord over twice the bulge squared times its error.
+static const double BULGE_SCALE = 4294967296.0;
+
+// fseek() and ftell() take a long, which is 32 bits on Windows, so offsets
+// go through the 64-bit variants. Offsets the platform cannot reach fail.
+static bool SeekFile(FILE *pFile, std::uint64_t offset, int origin)
+{
+#ifdef _WIN32
+    if (offset > (std::uint64_t)std::numeric_limits<__int64>::max()) return false;
+    return _fseeki64(pFile, (__int64)offset, origin) == 0;
+#else
+    if (offset > (std::uint64_t)std::numeric_limits<off_t>::max()) return false;
+    return fseeko(pFile, (off_t)offset, origin) == 0;
+#endif
+}
+
+static bool TellFile(FILE *pFile, std::uint64_t *offset)
+{
+#ifdef _WIN32
+    __int64 pos = _ftelli64(pFile);
+#else
+    off_t pos = ftello(pFile);
+#endif
+    if (pos < 0) return false;
+    *offset = (std::uint64_t)pos;
+    return true;
+}
+
+// Maps the whole file read-only. Where mapping is not available, or fails,
+// the file is read into buffer with a single fread instead.
+static bool MapFile(const char *filePath, const unsigned char **data, std::size_t *size, bool *mapped, std::vector<unsigned char> *buffer)
+{
+    *data = NULL;
+    *size = 0;
+    *mapped = false;
+#ifndef _WIN32
+    int fd = open(filePath, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            ::close(fd);
+            *data = static_cast<const unsigned char *>(p);
+            *size = (std::size_t)st.st_size;
+            *mapped = true;
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+    FILE *pFile = fopen(filePath, "rb");
+    if (pFile == NULL) return false;
+    std::uint64_t length = 0;
+    bool ok = SeekFile(pFile, 0, SEEK_END) && TellFile(pFile, &length)
+        && length <= (std::uint64_t)std::numeric_limits<std::size_t>::max()
+        && SeekFile(pFile, 0, SEEK_SET);
+    if (ok) {
+        buffer->resize((std::size_t)length);
+        ok = length == 0 || fread(buffer->data(), 1, buffer->size(), pFile) == buffer->size();
+    }
+    fclose(pFile);
+    if (!ok) return false;
+    *data = buffer->data();
+    *size = buffer->size();
+    return true;
+}
+
+static void UnmapFile(const unsigned char *data, std::size_t size, bool mapped, std::vector<unsigned char> *buffer)
+{
+#ifndef _WIN32
+    if (mapped) munmap(const_cast<unsigned char *>(data), size);
+#endif
+    buffer->clear();
+    buffer->shrink_to_fit();
+}
+
+static bool isV2File(const unsigned char *data, std::size_t size)
+{
+    return size >= sizeof(SHAPEFILEHEADER) && memcmp(data, SHAPEFILE_MAGIC, sizeof(SHAPEFILE_MAGIC)) == 0;
+}
+
+static bool isCompactFile(const unsigned char *data, std::size_t size)
+{
+    std::uint32_t version = 0;
+    if (size < sizeof(COMPACTHEADER) || memcmp(data, SHAPEFILE_MAGIC, sizeof(SHAPEFILE_MAGIC)) != 0) return false;
+    memcpy(&version, data + sizeof(SHAPEFILE_MAGIC), sizeof(version));
+    return version == SHAPEFILE_COMPACT;
+}
+
+// Builds the primitive the way the legacy readFromStream() does, so both
+// layouts load into exactly the same shapes.
+static std::unique_ptr<PRIMITIVE> DecodePrimitive(const PRIMRECORD &rec)
+{
+    if (rec.nKind == GBAPY_LINE) {
+        std::unique_ptr<LINE> line = std::make_unique<LINE>();
+        line->terms[0] = TERMINAL(rec.terms[0], rec.terms[1]);
+        line->terms[1] = TERMINAL(rec.terms[2], rec.terms[3]);
+        return line;
+    }
+    if (rec.nKind == GBAPY_ARC) {
+        std::unique_ptr<ARC> arc = std::make_unique<ARC>();
+        arc->terms[0] = TERMINAL(rec.terms[0], rec.terms[1]);
+        arc->terms[1] = TERMINAL(rec.terms[2], rec.terms[3]);
+        arc->center = TERMINAL(rec.center[0], rec.center[1]);
+        arc->radius = rec.radius;
+        arc->startAngle = rec.startAngle;
+        arc->endAngle = rec.endAngle;
+        arc->clockWise = rec.clockWise != 0;
+        arc->updateCache();
+        return arc;
+    }
+    return NULL;
+}
+
+static void EncodePrimitive(const PRIMITIVE *pr, PRIMRECORD *rec)
+{
+    memset(rec, 0, sizeof(PRIMRECORD));
+    rec->nKind = pr->nKind;
+    rec->terms[0] = pr->terms[0].x;
+    rec->terms[1] = pr->terms[0].y;
+    rec->terms[2] = pr->terms[1].x;
+    rec->terms[3] = pr->terms[1].y;
+    if (pr->nKind == GBAPY_ARC) {
+        const ARC *arc = static_cast<const ARC *>(pr);
+        rec->clockWise = arc->clockWise ? 1 : 0;
+        rec->center[0] = arc->center.x;
+        rec->center[1] = arc->center.y;
+        rec->radius = arc->radius;
+        rec->startAngle = arc->startAngle;
+        rec->endAngle = arc->endAngle;
+    }
+}
+
+// Legacy fields are packed without padding, so they are copied out rather
+// than cast in place.
+template <class T>
+static bool ReadField(const unsigned char *data, std::size_t size, std::size_t *pos, T *ret)
+{
+    if (size - *pos < sizeof(T)) return false;
+    memcpy(ret, data + *pos, sizeof(T));
+    *pos += sizeof(T);
+    return true;
+}
+
+// The legacy layout is an int shape count followed by every SHAPE as
+// written by SHAPE::write2Stream. One pass finds where each shape starts,
+// then the shapes are decoded in parallel.
+static bool ReadLegacyShapes(const unsigned char *data, std::size_t size, std::vector<SHAPE> *shapes)
+{
+    std::size_t pos = 0;
+    int n = 0;
+    if (!ReadField(data, size, &pos, &n) || n < 0) return false;
+    // every shape holds at least its primitive count
+    if ((std::size_t)n > (size - pos) / sizeof(int)) return false;
+
+    std::vector<std::size_t> starts(n);
+    for (int i = 0; i < n; i++) {
+        int count = 0;
+        starts[i] = pos;
+        if (!ReadField(data, size, &pos, &count) || count < 0) return false;
+        for (int j = 0; j < count; j++) {
+            int nKind = 0;
+            if (!ReadField(data, size, &pos, &nKind)) return false;
+            std::size_t bytes;
+            if (nKind == GBAPY_LINE) bytes = 4 * sizeof(double);
+            else if (nKind == GBAPY_ARC) bytes = 9 * sizeof(double) + sizeof(bool);
+            else return false;
+            if (size - pos < bytes) return false;
+            pos += bytes;
+        }
+    }
+
+    std::size_t first = shapes->size();
+    shapes->resize(first + n);
+    ParallelFor(n, [&](int i, int) {
+        SHAPE &shp = shapes->at(first + i);
+        std::size_t at = starts[i];
+        int count = 0;
+        ReadField(data, size, &at, &count);
+        shp.prims.reserve(count);
+        for (int j = 0; j < count; j++) {
+            PRIMRECORD rec;
+            bool cw = true;
+            memset(&rec, 0, sizeof(rec));
+            ReadField(data, size, &at, &rec.nKind);
+            for (int k = 0; k < 4; k++) ReadField(data, size, &at, &rec.terms[k]);
+            if (rec.nKind == GBAPY_ARC) {
+                ReadField(data, size, &at, &rec.center[0]);
+                ReadField(data, size, &at, &rec.center[1]);
+                ReadField(data, size, &at, &rec.radius);
+                ReadField(data, size, &at, &rec.startAngle);
+                ReadField(data, size, &at, &rec.endAngle);
+                ReadField(data, size, &at, &cw);
+                rec.clockWise = cw ? 1 : 0;
+            }
+            shp.prims.push_back(DecodePrimitive(rec));
+        }
+        shp.update();
+    });
+    return true;
+}
+
+static std::uint64_t ZigZag(std::int64_t v)
+{
+    return ((std::uint64_t)v << 1) ^ (std::uint64_t)(v >> 63);
+}
+
+static std::int64_t UnZigZag(std::uint64_t v)
+{
+    return (std::int64_t)(v >> 1) ^ -(std::int64_t)(v & 1);
+}
+
+static void PutVarint(std::uint64_t v, std::vector<unsigned char> *out)
+{
+    while (v >= 0x80) {
+        out->push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back((unsigned char)v);
+}
+
+static bool GetVarint(const unsigned char *data, std::size_t size, std::size_t *pos, std::uint64_t *ret)
+{
+    std::uint64_t v = 0;
+    for (int shift = 0; shift < 64 && *pos < size; shift += 7) {
+        unsigned char b = data[(*pos)++];
+        v |= (std::uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *ret = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool GetSigned(const unsigned char *data, std::size_t size, std::size_t *pos, std::int64_t *ret)
+{
+    std::uint64_t v;
+    if (!GetVarint(data, size, pos, &v)) return false;
+    *ret = UnZigZag(v);
+    return true;
+}
+
+// Fails for coordinates out of range and for NaN.
+static bool Quantize(double v, double grid, std::int64_t *ret)
+{
+    double q = std::floor(v / grid + 0.5);
+    if (!(std::abs(q) < COMPACT_LIMIT)) return false;
+    *ret = (std::int64_t)q;
+    return true;
+}
+
+// The arc through t1 and t2 with bulge the tangent of a quarter of its
+// sweep, positive for counter-clockwise; the centre sits on the bisector
+// of the chord.
+static std::unique_ptr<PRIMITIVE> MakeArc(const TERMINAL &t1, const TERMINAL &t2, double bulge)
+{
+    double dx = t2.x - t1.x;
+    double dy = t2.y - t1.y;
+    double chord = sqrt(dx * dx + dy * dy);
+    double height = bulge * chord / 2;
+    double r = chord * (1 + bulge * bulge) / (4 * std::abs(bulge));
+    double d = height < 0 ? height + r : height - r;
+    TERMINAL c((t1.x + t2.x) / 2 + d * dy / chord, (t1.y + t2.y) / 2 - d * dx / chord);
+    return std::make_unique<ARC>(c, r, t1, t2, bulge < 0);
+}
+
+// Appends the compact form of shp, without its byte count. Arcs too flat
+// for a bulge step, or whose ends meet on the grid, are stored as lines.
+static bool EncodeCompactShape(const SHAPE &shp, double grid, std::vector<unsigned char> *out)
+{
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+
+    PutVarint(shp.prims.size(), out);
+    for (std::size_t i = 0; i < shp.prims.size(); i++) {
+        const PRIMITIVE *pr = shp.prims[i].get();
+        std::int64_t sx, sy, ex, ey;
+        std::int64_t h = 0;
+        if (!Quantize(pr->terms[0].x, grid, &sx) || !Quantize(pr->terms[0].y, grid, &sy)
+            || !Quantize(pr->terms[1].x, grid, &ex) || !Quantize(pr->terms[1].y, grid, &ey)) return false;
+        if (i == 0) {
+            PutVarint(ZigZag(sx), out);
+            PutVarint(ZigZag(sy), out);
+            x = sx;
+            y = sy;
+        }
+        if (pr->nKind == GBAPY_ARC && (sx != ex || sy != ey)) {
+            const ARC::CACHE &cache = static_cast<const ARC *>(pr)->getCache();
+            double bulge = tan((cache.sweepEnd - cache.sweepStart) * M_PI / 720.0);
+            if (!Quantize(bulge, 1 / BULGE_SCALE, &h)) return false;
+        }
+
+        bool jump = sx != x || sy != y;
+        PutVarint((ZigZag(ex - sx) << 2) | (jump ? COMPACT_JUMP : 0) | (h != 0 ? COMPACT_ARC : 0), out);
+        if (jump) {
+            PutVarint(ZigZag(sx - x), out);
+            PutVarint(ZigZag(sy - y), out);
+        }
+        PutVarint(ZigZag(ey - sy), out);
+        if (h != 0) PutVarint(ZigZag(h), out);
+        x = ex;
+        y = ey;
+    }
+    return true;
+}
+
+static bool DecodeCompactShape(const unsigned char *data, std::size_t size, double grid, SHAPE *shp)
+{
+    std::size_t pos = 0;
+    std::uint64_t count = 0;
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+
+    // every edge takes two bytes at least
+    if (!GetVarint(data, size, &pos, &count) || count > size) return false;
+    if (count > 0 && (!GetSigned(data, size, &pos, &x) || !GetSigned(data, size, &pos, &y))) return false;
+    shp->prims.reserve(count);
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::uint64_t head;
+        std::int64_t dx, dy, h;
+        if (!GetVarint(data, size, &pos, &head)) return false;
+        if (head & COMPACT_JUMP) {
+            if (!GetSigned(data, size, &pos, &dx) || !GetSigned(data, size, &pos, &dy)) return false;
+            x += dx;
+            y += dy;
+        }
+        TERMINAL t1(x * grid, y * grid);
+        if (!GetSigned(data, size, &pos, &dy)) return false;
+        x += UnZigZag(head >> 2);
+        y += dy;
+        TERMINAL t2(x * grid, y * grid);
+
+        if (head & COMPACT_ARC) {
+            if (!GetSigned(data, size, &pos, &h) || h == 0 || (head >> 2 == 0 && dy == 0)) return false;
+            shp->prims.push_back(MakeArc(t1, t2, h / BULGE_SCALE));
+        }
+        else {
+            std::unique_ptr<LINE> line = std::make_unique<LINE>();
+            line->terms[0] = t1;
+            line->terms[1] = t2;
+            shp->prims.push_back(std::move(line));
+        }
+    }
+    return pos == size;
+}
+
+// One pass over the byte counts finds where each shape starts, then the
+// shapes are decoded on the worker threads.
+static bool ReadCompactShapes(const unsigned char *data, std::size_t size, std::vector<SHAPE> *shapes)
+{
+    COMPACTHEADER header;
+    memcpy(&header, data, sizeof(header));
+    if (!(header.grid > 0) || header.shapeCount > size || header.shapeCount >= (std::uint64_t)INT_MAX) return false;
+
+    int n = (int)header.shapeCount;
+    std::vector<std::size_t> starts(n);
+    std::vector<std::size_t> ends(n);
+    std::size_t pos = sizeof(COMPACTHEADER);
+    for (int i = 0; i < n; i++) {
+        std::uint64_t bytes;
+        if (!GetVarint(data, size, &pos, &bytes) || bytes > size - pos) return false;
+        starts[i] = pos;
+        pos += bytes;
+        ends[i] = pos;
+    }
+
+    std::size_t first = shapes->size();
+    std::atomic<bool> failed(false);
+    shapes->resize(first + n);
+    ParallelFor(n, [&](int i, int) {
+        SHAPE &shp = shapes->at(first + i);
+        if (!DecodeCompactShape(data + starts[i], ends[i] - starts[i], header.grid, &shp)) {
+            failed = true;
+            return;
+        }
+        shp.update();
+    });
+    if (failed) {
+        shapes->resize(first);
+        return false;
+    }
+    return true;
+}
+
+bool ReadShapeFile(const char *filePath, std::vector<SHAPE> *shapes)
+{
+    SHAPEFILEVIEW view;
+    if (view.open(filePath)) {
+        std::size_t first = shapes->size();
+        shapes->resize(first + view.getShapeCount());
+        ParallelFor((int)view.getShapeCount(), [&](int i, int) {
+            view.getShape(i, &shapes->at(first + i));
+        });
+        return true;
+    }
+
+    const unsigned char *data;
+    std::size_t size;
+    bool mapped;
+    std::vector<unsigned char> buffer;
+    if (!MapFile(filePath, &data, &size, &mapped, &buffer)) return false;
+    bool ok;
+    if (isCompactFile(data, size)) ok = ReadCompactShapes(data, size, shapes);
+    else ok = !isV2File(data, size) && ReadLegacyShapes(data, size, shapes);
+    UnmapFile(data, size, mapped, &buffer);
+    return ok;
+}
+
+bool WriteShapeFile(const char *filePath, std::vector<SHAPE> *shapes)
+{
+    return WriteShapeFile(filePath, shapes, SHAPEFILE_V2);
+}
+
+static bool WriteLegacyShapes(FILE *pFile, std::vector<SHAPE> *shapes)
+{
+    int n = (int)shapes->size();
+
+    fwrite(&n, 1, sizeof(int), pFile);
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        shapes->at(i).write2Stream(pFile);
+    }
+    return ferror(pFile) == 0;
+}
+
+static bool WriteV2Shapes(FILE *pFile, std::vector<SHAPE> *shapes)
+{
+    SHAPEFILEHEADER header;
+    std::vector<std::uint64_t> table(shapes->size() + 1);
+    std::uint64_t count = 0;
+
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        table[i] = count;
+        count += shapes->at(i).prims.size();
+    }
+    table[shapes->size()] = count;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHAPEFILE_MAGIC, sizeof(SHAPEFILE_MAGIC));
+    header.version = SHAPEFILE_V2;
+    header.recordSize = sizeof(PRIMRECORD);
+    header.shapeCount = shapes->size();
+    header.primCount = count;
+    header.tableOffset = sizeof(SHAPEFILEHEADER);
+    header.primOffset = header.tableOffset + table.size() * sizeof(std::uint64_t);
+
+    if (fwrite(&header, sizeof(header), 1, pFile) != 1) return false;
+    if (fwrite(table.data(), sizeof(std::uint64_t), table.size(), pFile) != table.size()) return false;
+
+    std::vector<PRIMRECORD> records;
+    records.reserve(WRITE_CHUNK);
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        const SHAPE &shp = shapes->at(i);
+        for (std::size_t j = 0; j < shp.prims.size(); j++) {
+            records.push_back(PRIMRECORD());
+            EncodePrimitive(shp.prims[j].get(), &records.back());
+            if (records.size() == WRITE_CHUNK) {
+                if (fwrite(records.data(), sizeof(PRIMRECORD), records.size(), pFile) != records.size()) return false;
+                records.clear();
+            }
+        }
+    }
+    if (records.size() > 0 && fwrite(records.data(), sizeof(PRIMRECORD), records.size(), pFile) != records.size()) return false;
+    return true;
+}
+
+static void MakeCompactHeader(double grid, std::uint64_t shapeCount, std::uint64_t primCount, COMPACTHEADER *header)
+{
+    memset(header, 0, sizeof(COMPACTHEADER));
+    memcpy(header->magic, SHAPEFILE_MAGIC, sizeof(SHAPEFILE_MAGIC));
+    header->version = SHAPEFILE_COMPACT;
+    header->grid = grid;
+    header->shapeCount = shapeCount;
+    header->primCount = primCount;
+}
+
+// Each shape is encoded into a scratch buffer first, as its byte count
+// goes in front of it.
+static bool WriteCompactShapes(FILE *pFile, std::vector<SHAPE> *shapes, double grid)
+{
+    COMPACTHEADER header;
+    std::uint64_t count = 0;
+
+    if (!(grid > 0)) return false;
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        count += shapes->at(i).prims.size();
+    }
+    MakeCompactHeader(grid, shapes->size(), count, &header);
+    if (fwrite(&header, sizeof(header), 1, pFile) != 1) return false;
+
+    std::vector<unsigned char> shape;
+    std::vector<unsigned char> bytes;
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        shape.clear();
+        if (!EncodeCompactShape(shapes->at(i), grid, &shape)) return false;
+        PutVarint(shape.size(), &bytes);
+        bytes.insert(bytes.end(), shape.begin(), shape.end());
+        if (bytes.size() >= WRITE_CHUNK * sizeof(PRIMRECORD)) {
+            if (fwrite(bytes.data(), 1, bytes.size(), pFile) != bytes.size()) return false;
+            bytes.clear();
+        }
+    }
+    if (bytes.size() > 0 && fwrite(bytes.data(), 1, bytes.size(), pFile) != bytes.size()) return false;
+    return true;
+}
+
+bool WriteShapeFile(const char *filePath, std::vector<SHAPE> *shapes, int version)
+{
+    return WriteShapeFile(filePath, shapes, version, SHAPEFILE_GRID);
+}
+
+bool WriteShapeFile(const char *filePath, std::vector<SHAPE> *shapes, int version, double grid)
+{
+    FILE *pFile = fopen(filePath, "wb");
+    if (pFile == NULL) return false;
+
+    bool ok;
+    if (version == SHAPEFILE_LEGACY) ok = WriteLegacyShapes(pFile, shapes);
+    else if (version == SHAPEFILE_COMPACT) ok = WriteCompactShapes(pFile, shapes, grid);
+    else ok = WriteV2Shapes(pFile, shapes);
+    return fclose(pFile) == 0 && ok;
+}
+
+SHAPEFILEVIEW::SHAPEFILEVIEW() {
+    m_data = NULL;
+    m_size = 0;
+    m_mapped = false;
+    m_header = NULL;
+    m_table = NULL;
+    m_prims = NULL;
+}
+
+SHAPEFILEVIEW::~SHAPEFILEVIEW() {
+    this->close();
+}
+
+// Everything the accessors rely on is checked here, so they need no checks
+// of their own.
+bool SHAPEFILEVIEW::open(const char *filePath) {
+    this->close();
+    if (!MapFile(filePath, &m_data, &m_size, &m_mapped, &m_buffer)) return false;
+
+    bool ok = isV2File(m_data, m_size);
+    const SHAPEFILEHEADER *header = reinterpret_cast<const SHAPEFILEHEADER *>(m_data);
+    if (ok) {
+        ok = header->version == SHAPEFILE_V2 && header->recordSize == sizeof(PRIMRECORD)
+            && header->shapeCount < (std::uint64_t)INT_MAX
+            && header->tableOffset % 8 == 0 && header->primOffset % 8 == 0
+            && header->tableOffset <= m_size
+            && (m_size - header->tableOffset) / sizeof(std::uint64_t) > header->shapeCount
+            && header->primOffset <= m_size
+            && (m_size - header->primOffset) / sizeof(PRIMRECORD) >= header->primCount;
+    }
+    if (ok) {
+        m_table = reinterpret_cast<const std::uint64_t *>(m_data + header->tableOffset);
+        m_prims = reinterpret_cast<const PRIMRECORD *>(m_data + header->primOffset);
+        ok = m_table[0] == 0 && m_table[header->shapeCount] == header->primCount;
+        for (std::uint64_t i = 0; ok && i < header->shapeCount; i++) {
+            ok = m_table[i] <= m_table[i + 1];
+        }
+        for (std::uint64_t i = 0; ok && i < header->primCount; i++) {
+            ok = m_prims[i].nKind == GBAPY_LINE || m_prims[i].nKind == GBAPY_ARC;
+        }
+    }
+    if (!ok) {
+        this->close();
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+void SHAPEFILEVIEW::close() {
+    if (m_data != NULL) UnmapFile(m_data, m_size, m_mapped, &m_buffer);
+    m_data = NULL;
+    m_size = 0;
+    m_mapped = false;
+    m_header = NULL;
+    m_table = NULL;
+    m_prims = NULL;
+}
+
+std::size_t SHAPEFILEVIEW::getShapeCount() const {
+    return m_header != NULL ? (std::size_t)m_header->shapeCount : 0;
+}
+
+std::size_t SHAPEFILEVIEW::getPrimCount(std::size_t shape) const {
+    return (std::size_t)(m_table[shape + 1] - m_table[shape]);
+}
+
+const PRIMRECORD *SHAPEFILEVIEW::getPrims(std::size_t shape) const {
+    return m_prims + m_table[shape];
+}
+
+void SHAPEFILEVIEW::getShape(std::size_t shape, SHAPE *shp) const {
+    const PRIMRECORD *recs = this->getPrims(shape);
+    std::size_t count = this->getPrimCount(shape);
+
+    shp->clear();
+    shp->prims.reserve(count);
+    for (std::size_t j = 0; j < count; j++) {
+        shp->prims.push_back(DecodePrimitive(recs[j]));
+    }
+    shp->update();
+}
+
+// Reads one legacy primitive into rec; false at the end of the file or on
+// an unknown kind.
+static bool ReadLegacyRecord(FILE *pFile, PRIMRECORD *rec)
+{
+    double fields[9];
+    bool cw = true;
+
+    memset(rec, 0, sizeof(PRIMRECORD));
+    if (fread(&rec->nKind, sizeof(int), 1, pFile) != 1) return false;
+    if (rec->nKind == GBAPY_LINE) {
+        if (fread(fields, sizeof(double), 4, pFile) != 4) return false;
+    }
+    else if (rec->nKind == GBAPY_ARC) {
+        if (fread(fields, sizeof(double), 9, pFile) != 9) return false;
+        if (fread(&cw, sizeof(bool), 1, pFile) != 1) return false;
+        rec->center[0] = fields[4];
+        rec->center[1] = fields[5];
+        rec->radius = fields[6];
+        rec->startAngle = fields[7];
+        rec->endAngle = fields[8];
+        rec->clockWise = cw ? 1 : 0;
+    }
+    else {
+        return false;
+    }
+    memcpy(rec->terms, fields, sizeof(rec->terms));
+    return true;
+}
+
+SHAPEREADER::SHAPEREADER() {
+    m_file = NULL;
+    m_table = NULL;
+    m_version = 0;
+    m_count = 0;
+    m_index = 0;
+    m_first = 0;
+    m_primCount = 0;
+    m_size = 0;
+    m_grid = 0;
+    m_failed = false;
+}
+
+SHAPEREADER::~SHAPEREADER() {
+    this->close();
+}
+
+// A version 2 file is read through two handles, one walking the shape
+// table and one the primitives, so neither has to be held in memory.
+bool SHAPEREADER::open(const char *filePath) {
+    this->close();
+    m_file = fopen(filePath, "rb");
+    if (m_file == NULL) return false;
+
+    // the size bounds every count and length read from the file later
+    if (!SeekFile(m_file, 0, SEEK_END) || !TellFile(m_file, &m_size) || !SeekFile(m_file, 0, SEEK_SET)) {
+        this->close();
+        return false;
+    }
+
+    SHAPEFILEHEADER header;
+    std::size_t n = fread(&header, 1, sizeof(header), m_file);
+    bool ok;
+    if (isCompactFile(reinterpret_cast<const unsigned char *>(&header), n)) {
+        COMPACTHEADER compact;
+        memcpy(&compact, &header, sizeof(compact));
+        m_version = SHAPEFILE_COMPACT;
+        m_count = compact.shapeCount;
+        m_grid = compact.grid;
+        ok = m_grid > 0 && fseek(m_file, sizeof(COMPACTHEADER), SEEK_SET) == 0;
+    }
+    else if (n == sizeof(header) && isV2File(reinterpret_cast<const unsigned char *>(&header), n)) {
+        m_version = SHAPEFILE_V2;
+        m_count = header.shapeCount;
+        m_primCount = header.primCount;
+        m_table = fopen(filePath, "rb");
+        ok = header.version == SHAPEFILE_V2 && header.recordSize == sizeof(PRIMRECORD)
+            && m_table != NULL
+            && SeekFile(m_table, header.tableOffset, SEEK_SET)
+            && fread(&m_first, sizeof(std::uint64_t), 1, m_table) == 1 && m_first == 0
+            && SeekFile(m_file, header.primOffset, SEEK_SET);
+    }
+    else {
+        int count = 0;
+        m_version = SHAPEFILE_LEGACY;
+        ok = fseek(m_file, 0, SEEK_SET) == 0 && fread(&count, sizeof(int), 1, m_file) == 1 && count >= 0;
+        m_count = (std::uint64_t)count;
+    }
+    if (!ok) {
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+void SHAPEREADER::close() {
+    if (m_file != NULL) fclose(m_file);
+    if (m_table != NULL) fclose(m_table);
+    m_file = NULL;
+    m_table = NULL;
+    m_version = 0;
+    m_count = 0;
+    m_index = 0;
+    m_first = 0;
+    m_primCount = 0;
+    m_size = 0;
+    m_grid = 0;
+    m_records.clear();
+    m_bytes.clear();
+    m_failed = false;
+}
+
+std::uint64_t SHAPEREADER::getCount() const {
+    return m_count;
+}
+
+bool SHAPEREADER::isFailed() const {
+    return m_failed;
+}
+
+bool SHAPEREADER::read(SHAPE *shp) {
+    if (m_file == NULL || m_failed || m_index >= m_count) return false;
+
+    shp->clear();
+    bool ok;
+    if (m_version == SHAPEFILE_COMPACT) ok = this->readCompact(shp);
+    else if (m_version == SHAPEFILE_V2) ok = this->readV2(shp);
+    else ok = this->readLegacy(shp);
+    if (!ok) {
+        shp->clear();
+        m_failed = true;
+        return false;
+    }
+    m_index++;
+    shp->update();
+    return true;
+}
+
+// Bytes between the read position of pFile and size, 0 past the end.
+static std::uint64_t GetRemaining(FILE *pFile, std::uint64_t size)
+{
+    std::uint64_t pos = 0;
+    if (!TellFile(pFile, &pos) || pos > size) return 0;
+    return size - pos;
+}
+
+bool SHAPEREADER::readLegacy(SHAPE *shp) {
+    int count = 0;
+    if (fread(&count, sizeof(int), 1, m_file) != 1 || count < 0) return false;
+    // a line, the shortest record, is its kind and four doubles
+    if ((std::uint64_t)count > GetRemaining(m_file, m_size) / (sizeof(int) + 4 * sizeof(double))) return false;
+    shp->prims.reserve(count);
+    for (int j = 0; j < count; j++) {
+        PRIMRECORD rec;
+        if (!ReadLegacyRecord(m_file, &rec)) return false;
+        shp->prims.push_back(DecodePrimitive(rec));
+    }
+    return true;
+}
+
+bool SHAPEREADER::readV2(SHAPE *shp) {
+    std::uint64_t next = 0;
+    if (fread(&next, sizeof(std::uint64_t), 1, m_table) != 1) return false;
+    if (next < m_first || next > m_primCount) return false;
+
+    m_records.resize((std::size_t)(next - m_first));
+    m_first = next;
+    if (fread(m_records.data(), sizeof(PRIMRECORD), m_records.size(), m_file) != m_records.size()) return false;
+    shp->prims.reserve(m_records.size());
+    for (std::size_t j = 0; j < m_records.size(); j++) {
+        if (m_records[j].nKind != GBAPY_LINE && m_records[j].nKind != GBAPY_ARC) return false;
+        shp->prims.push_back(DecodePrimitive(m_records[j]));
+    }
+    return true;
+}
+
+bool SHAPEREADER::readCompact(SHAPE *shp) {
+    std::uint64_t bytes = 0;
+    int c;
+    for (int shift = 0; ; shift += 7) {
+        if (shift >= 64 || (c = fgetc(m_file)) == EOF) return false;
+        bytes |= (std::uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) break;
+    }
+    if (bytes > GetRemaining(m_file, m_size)) return false;
+    m_bytes.resize((std::size_t)bytes);
+    if (fread(m_bytes.data(), 1, m_bytes.size(), m_file) != m_bytes.size()) return false;
+    return DecodeCompactShape(m_bytes.data(), m_bytes.size(), m_grid, shp);
+}
+
+SHAPEWRITER::SHAPEWRITER() {
+    m_file = NULL;
+    m_table = NULL;
+    m_version = SHAPEFILE_V2;
+    m_count = 0;
+    m_primCount = 0;
+    m_grid = SHAPEFILE_GRID;
+    m_failed = false;
+}
+
+SHAPEWRITER::~SHAPEWRITER() {
+    this->close();
+}
+
+bool SHAPEWRITER::open(const char *filePath, int version) {
+    return this->open(filePath, version, SHAPEFILE_GRID);
+}
+
+// Leaves room for the header or the legacy count, which close() rewrites.
+bool SHAPEWRITER::open(const char *filePath, int version, double grid) {
+    this->close();
+    m_version = version == SHAPEFILE_LEGACY || version == SHAPEFILE_COMPACT ? version : SHAPEFILE_V2;
+    m_grid = grid;
+    if (!(grid > 0)) return false;
+    m_file = fopen(filePath, "wb");
+    if (m_file == NULL) return false;
+
+    if (m_version == SHAPEFILE_COMPACT) {
+        COMPACTHEADER header;
+        memset(&header, 0, sizeof(header));
+        m_failed = fwrite(&header, sizeof(header), 1, m_file) != 1;
+    }
+    else if (m_version == SHAPEFILE_V2) {
+        SHAPEFILEHEADER header;
+        std::uint64_t first = 0;
+        memset(&header, 0, sizeof(header));
+        m_table = tmpfile();
+        m_failed = m_table == NULL
+            || fwrite(&header, sizeof(header), 1, m_file) != 1
+            || fwrite(&first, sizeof(std::uint64_t), 1, m_table) != 1;
+    }
+    else {
+        int count = 0;
+        m_failed = fwrite(&count, sizeof(int), 1, m_file) != 1;
+    }
+    return !m_failed;
+}
+
+bool SHAPEWRITER::write(const SHAPE &shp) {
+    if (m_file == NULL || m_failed) return false;
+
+    if (m_version == SHAPEFILE_LEGACY) {
+        if (m_count >= (std::uint64_t)INT_MAX) {
+            m_failed = true;
+            return false;
+        }
+        const_cast<SHAPE &>(shp).write2Stream(m_file);
+        m_failed = ferror(m_file) != 0;
+    }
+    else if (m_version == SHAPEFILE_COMPACT) {
+        m_bytes.clear();
+        m_failed = !EncodeCompactShape(shp, m_grid, &m_bytes);
+        if (!m_failed) {
+            std::vector<unsigned char> count;
+            PutVarint(m_bytes.size(), &count);
+            m_failed = fwrite(count.data(), 1, count.size(), m_file) != count.size()
+                || fwrite(m_bytes.data(), 1, m_bytes.size(), m_file) != m_bytes.size();
+        }
+        m_primCount += shp.prims.size();
+    }
+    else {
+        m_records.resize(shp.prims.size());
+        for (std::size_t j = 0; j < shp.prims.size(); j++) {
+            EncodePrimitive(shp.prims[j].get(), &m_records[j]);
+        }
+        m_primCount += shp.prims.size();
+        m_failed = fwrite(m_records.data(), sizeof(PRIMRECORD), m_records.size(), m_file) != m_records.size()
+            || fwrite(&m_primCount, sizeof(std::uint64_t), 1, m_table) != 1;
+    }
+    m_count++;
+    return !m_failed;
+}
+
+bool SHAPEWRITER::close() {
+    if (m_file == NULL) return false;
+    bool ok = !m_failed;
+
+    if (ok && m_version == SHAPEFILE_COMPACT) {
+        COMPACTHEADER header;
+        MakeCompactHeader(m_grid, m_count, m_primCount, &header);
+        ok = fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, m_file) == 1;
+    }
+    else if (ok && m_version == SHAPEFILE_V2) {
+        SHAPEFILEHEADER header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SHAPEFILE_MAGIC, sizeof(SHAPEFILE_MAGIC));
+        header.version = SHAPEFILE_V2;
+        header.recordSize = sizeof(PRIMRECORD);
+        header.shapeCount = m_count;
+        header.primCount = m_primCount;
+        header.primOffset = sizeof(SHAPEFILEHEADER);
+        header.tableOffset = header.primOffset + m_primCount * sizeof(PRIMRECORD);
+
+        // the table follows the primitives, copied over from the spill file
+        std::uint64_t entries[1024];
+        std::size_t n;
+        ok = fflush(m_table) == 0 && fseek(m_table, 0, SEEK_SET) == 0;
+        while (ok && (n = fread(entries, sizeof(std::uint64_t), 1024, m_table)) > 0) {
+            ok = fwrite(entries, sizeof(std::uint64_t), n, m_file) == n;
+        }
+        ok = ok && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, m_file) == 1;
+    }
+    else if (ok) {
+        int count = (int)m_count;
+        ok = fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&count, sizeof(int), 1, m_file) == 1;
+    }
+    if (m_table != NULL) fclose(m_table);
+    ok = fclose(m_file) == 0 && ok;
+    m_file = NULL;
+    m_table = NULL;
+    m_count = 0;
+    m_primCount = 0;
+    m_records.clear();
+    m_bytes.clear();
+    m_failed = false;
+    return ok;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "shape.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+enum _SHAPEFILE_VERSION_
+{
+    SHAPEFILE_LEGACY = 1,
+    SHAPEFILE_V2 = 2,
+    SHAPEFILE_COMPACT = 3
+};
+
+// Default grid of the compact layout, a tenth of the engine's tolerance.
+#define SHAPEFILE_GRID 1E-6
+
+// A version 2 file is this header, a table of shapeCount + 1 indices of the
+// first primitive of every shape (the last one being primCount), and the
+// primitives as fixed size records. Everything is in host byte order, as
+// the legacy layout always was, and 8 byte aligned, so a mapped file can
+// be used in place.
+struct SHAPEFILEHEADER
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint64_t shapeCount;
+    std::uint64_t primCount;
+    std::uint64_t tableOffset;
+    std::uint64_t primOffset;
+};
+
+// Every field the legacy layout stores; lines leave the arc fields zero.
+struct PRIMRECORD
+{
+    std::int32_t nKind;
+    std::int32_t clockWise;
+    double terms[4];
+    double center[2];
+    double radius;
+    double startAngle;
+    double endAngle;
+};
+
+// A compact file is this header followed by every shape as a varint byte
+// count and the shape itself. A shape is its primitive count and its first
+// point, then one edge per primitive: the step to its end point, with a
+// jump to a new start where the chain breaks, and for an arc its bulge,
+// the tangent of a quarter of its sweep, positive for counter-clockwise.
+// Coordinates are whole multiples of grid, bulges of 2^-32, and both go in
+// as zigzag varint steps, so shared end points are stored once and the
+// centres and angles not at all.
+struct COMPACTHEADER
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    double grid;
+    std::uint64_t shapeCount;
+    std::uint64_t primCount;
+};
+
+// Reads any layout. The file is mapped, or read in one go where that is
+// not available, and the shapes are decoded on the worker threads.
+bool ReadShapeFile(const char *filePath, std::vector<SHAPE> *shapes);
+
+// Writes version 2, or the layout given. The compact layout snaps every
+// coordinate to grid, and fails for coordinates too large for it.
+bool WriteShapeFile(const char *filePath, std::vector<SHAPE> *shapes);
+bool WriteShapeFile(const char *filePath, std::vector<SHAPE> *shapes, int version);
+bool WriteShapeFile(const char *filePath, std::vector<SHAPE> *shapes, int version, double grid);
+
+// A version 2 file mapped read-only, so callers can walk the records in
+// place or decode just the shapes they need.
+struct SHAPEFILEVIEW
+{
+    SHAPEFILEVIEW();
+    ~SHAPEFILEVIEW();
+
+    // Fails for anything but a well formed version 2 file.
+    bool open(const char *filePath);
+    void close();
+
+    std::size_t getShapeCount() const;
+    std::size_t getPrimCount(std::size_t shape) const;
+    const PRIMRECORD *getPrims(std::size_t shape) const;
+    void getShape(std::size_t shape, SHAPE *shp) const;
+
+private:
+    SHAPEFILEVIEW(const SHAPEFILEVIEW &);
+    SHAPEFILEVIEW &operator=(const SHAPEFILEVIEW &);
+
+    const unsigned char *m_data;
+    std::size_t m_size;
+    bool m_mapped;
+    std::vector<unsigned char> m_buffer;
+    const SHAPEFILEHEADER *m_header;
+    const std::uint64_t *m_table;
+    const PRIMRECORD *m_prims;
+};
+
+// Reads the shapes of a file of any layout one at a time, so memory
+// holds no more than the largest shape whatever the size of the file.
+struct SHAPEREADER
+{
+    SHAPEREADER();
+    ~SHAPEREADER();
+
+    bool open(const char *filePath);
+    void close();
+
+    std::uint64_t getCount() const;
+
+    // Reads the next shape into shp and update()s it. Returns false after
+    // the last shape, or on a damaged file, which isFailed() tells apart.
+    bool read(SHAPE *shp);
+    bool isFailed() const;
+
+private:
+    SHAPEREADER(const SHAPEREADER &);
+    SHAPEREADER &operator=(const SHAPEREADER &);
+
+    bool readLegacy(SHAPE *shp);
+    bool readV2(SHAPE *shp);
+    bool readCompact(SHAPE *shp);
+
+    FILE *m_file;
+    FILE *m_table;
+    int m_version;
+    std::uint64_t m_count;
+    std::uint64_t m_index;
+    std::uint64_t m_first;
+    std::uint64_t m_primCount;
+    std::uint64_t m_size;
+    double m_grid;
+    std::vector<PRIMRECORD> m_records;
+    std::vector<unsigned char> m_bytes;
+    bool m_failed;
+};
+
+// Writes shapes one at a time. The counts are filled in by close(),
+// version 2 puts the shape table after the primitives, spilling it to a
+// temporary file until then, so memory does not grow with the file, and
+// the compact layout snaps to grid as WriteShapeFile() does.
+struct SHAPEWRITER
+{
+    SHAPEWRITER();
+    ~SHAPEWRITER();
+
+    bool open(const char *filePath, int version);
+    bool open(const char *filePath, int version, double grid);
+    bool write(const SHAPE &shp);
+
+    // Finishes the file; false if anything since open() failed.
+    bool close();
+
+private:
+    SHAPEWRITER(const SHAPEWRITER &);
+    SHAPEWRITER &operator=(const SHAPEWRITER &);
+
+    FILE *m_file;
+    FILE *m_table;
+    int m_version;
+    std::uint64_t m_count;
+    std::uint64_t m_primCount;
+    double m_grid;
+    std::vector<PRIMRECORD> m_records;
+    std::vector<unsigned char> m_bytes;
+    bool m_failed;
+};
@@ -0,0 +1,173 @@
+#include "sweep.h"
+#include "arc.h"
+#include "global.h"
+
+#include <algorithm>
+#include <cmath>
+
+CROSSINGTABLE::CROSSINGTABLE() {
+}
+
+void CROSSINGTABLE::clear() {
+    m_pieces.clear();
+    m_shapeFirst.clear();
+    m_first.clear();
+    m_crossings.clear();
+}
+
+int CROSSINGTABLE::getCount(int shape, int prim) const {
+    int k = m_shapeFirst[shape] + prim;
+    return m_first[k + 1] - m_first[k];
+}
+
+const CROSSING *CROSSINGTABLE::getCrossings(int shape, int prim) const {
+    int k = m_shapeFirst[shape] + prim;
+    if (m_first[k + 1] == m_first[k]) return NULL;
+    return &m_crossings[m_first[k]];
+}
+
+static TERMINAL pointAt(const PRIMITIVE *arc, double angle) {
+    return TERMINAL(arc->center.x + arc->radius * cos(angle * M_PI / 180.0f),
+        arc->center.y + arc->radius * sin(angle * M_PI / 180.0f));
+}
+
+// Lines are x-monotone already; arcs are cut at every multiple of 180
+// degrees inside their sweep. The pieces keep the margins getBoundingBox()
+// uses, so a pair of pieces overlaps whenever isConflict() could succeed.
+void CROSSINGTABLE::addPieces(const PRIMITIVE *pr, int shape, int prim) {
+    PIECE piece;
+    piece.shape = shape;
+    piece.prim = prim;
+
+    if (pr->nKind != GBAPY_ARC) {
+        pr->getBoundingBox(&piece.mn, &piece.mx);
+        m_pieces.push_back(piece);
+        return;
+    }
+
+    const ARC *arc = static_cast<const ARC *>(pr);
+    const double margin = EP * 10 + arc->radius * EP_A * M_PI / 180.0f;
+    double sa = arc->startAngle;
+    double ea = arc->endAngle;
+    arc->makeAbsoluteAngles(&sa, &ea);
+    double lo = sa < ea ? sa : ea;
+    double hi = sa < ea ? ea : sa;
+
+    double a0 = lo;
+    while (true) {
+        double a1 = (floor(a0 / 180.0f) + 1) * 180.0f;
+        if (a1 > hi) a1 = hi;
+
+        piece.mn = pointAt(arc, a0);
+        piece.mx = piece.mn;
+        pointAt(arc, a1).ensureRectContains(&piece.mn, &piece.mx);
+        double top = floor(a0 / 180.0f) * 180.0f + 90.0f;
+        if (top > a0 && top < a1) pointAt(arc, top).ensureRectContains(&piece.mn, &piece.mx);
+        if (a0 == lo || a1 == hi) {
+            arc->terms[0].ensureRectContains(&piece.mn, &piece.mx);
+            arc->terms[1].ensureRectContains(&piece.mn, &piece.mx);
+        }
+        piece.mn.x -= margin; piece.mn.y -= margin;
+        piece.mx.x += margin; piece.mx.y += margin;
+        m_pieces.push_back(piece);
+
+        if (a1 >= hi) break;
+        a0 = a1;
+    }
+}
+
+struct CROSSINGENTRY
+{
+    int key;
+    int order;
+    CROSSING crossing;
+};
+
+void CROSSINGTABLE::build(std::vector<SHAPE> *shapes) {
+    this->clear();
+
+    m_shapeFirst.resize(shapes->size() + 1);
+    int total = 0;
+    for (std::size_t s = 0; s < shapes->size(); s++) {
+        m_shapeFirst[s] = total;
+        total += static_cast<int>(shapes->at(s).prims.size());
+        for (std::size_t i = 0; i < shapes->at(s).prims.size(); i++) {
+            addPieces(shapes->at(s).prims[i].get(), (int)s, (int)i);
+        }
+    }
+    m_shapeFirst[shapes->size()] = total;
+
+    // sweep from left to right; a piece stays active until the sweep passes
+    // its right side, and only active pieces overlapping it in y are paired
+    std::sort(m_pieces.begin(), m_pieces.end(), [](const PIECE &a, const PIECE &b) {
+        return a.mn.x < b.mn.x;
+    });
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<int> active;
+    for (std::size_t n = 0; n < m_pieces.size(); n++) {
+        const PIECE &piece = m_pieces[n];
+        for (std::size_t k = 0; k < active.size();) {
+            const PIECE &other = m_pieces[active[k]];
+            if (other.mx.x < piece.mn.x) {
+                active[k] = active.back();
+                active.pop_back();
+                continue;
+            }
+            if (other.shape != piece.shape && other.mn.y <= piece.mx.y && piece.mn.y <= other.mx.y) {
+                int a = m_shapeFirst[piece.shape] + piece.prim;
+                int b = m_shapeFirst[other.shape] + other.prim;
+                pairs.push_back(a < b ? std::make_pair(a, b) : std::make_pair(b, a));
+            }
+            k++;
+        }
+        active.push_back((int)n);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    std::vector<int> owners(total);
+    for (std::size_t s = 0; s < shapes->size(); s++) {
+        for (int k = m_shapeFirst[s]; k < m_shapeFirst[s + 1]; k++) owners[k] = (int)s;
+    }
+
+    std::vector<CROSSINGENTRY> entries;
+    for (std::size_t n = 0; n < pairs.size(); n++) {
+        for (int side = 0; side < 2; side++) {
+            int a = side == 0 ? pairs[n].first : pairs[n].second;
+            int b = side == 0 ? pairs[n].second : pairs[n].first;
+            int sa = owners[a];
+            int sb = owners[b];
+            PRIMITIVE *pa = shapes->at(sa).prims[a - m_shapeFirst[sa]].get();
+            PRIMITIVE *pb = shapes->at(sb).prims[b - m_shapeFirst[sb]].get();
+            TERMINAL p1, p2;
+            if (isConflict(pa, pb, &p1, &p2) != 1) continue;
+
+            CROSSINGENTRY entry;
+            entry.key = a;
+            entry.crossing.shape = sb;
+            entry.crossing.prim = b - m_shapeFirst[sb];
+            if (p1.isValid) {
+                entry.order = 2 * b;
+                entry.crossing.p = p1;
+                entries.push_back(entry);
+            }
+            if (p2.isValid) {
+                entry.order = 2 * b + 1;
+                entry.crossing.p = p2;
+                entries.push_back(entry);
+            }
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const CROSSINGENTRY &a, const CROSSINGENTRY &b) {
+        return a.key != b.key ? a.key < b.key : a.order < b.order;
+    });
+
+    m_first.assign(total + 1, 0);
+    m_crossings.reserve(entries.size());
+    for (std::size_t n = 0; n < entries.size(); n++) {
+        m_first[entries[n].key + 1]++;
+        m_crossings.push_back(entries[n].crossing);
+    }
+    for (int k = 0; k < total; k++) m_first[k + 1] += m_first[k];
+    m_pieces.clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "shape.h"
+#include "terminal.h"
+
+#include <vector>
+
+// A point where a primitive crosses primitive `prim` of shape `shape`.
+struct CROSSING
+{
+    int shape;
+    int prim;
+    TERMINAL p;
+};
+
+// Every crossing between primitives of different shapes, found in a single
+// sweep over the x-monotone pieces of all primitives (arcs are split where
+// they turn back in x). Crossings are listed per primitive, ordered by the
+// other shape and primitive index, and computed with that primitive as the
+// first argument of isConflict(), the way a probe would see them.
+struct CROSSINGTABLE
+{
+    CROSSINGTABLE();
+
+    void build(std::vector<SHAPE> *shapes);
+    void clear();
+
+    int getCount(int shape, int prim) const;
+    const CROSSING *getCrossings(int shape, int prim) const;
+
+private:
+    struct PIECE
+    {
+        TERMINAL mn;
+        TERMINAL mx;
+        int shape;
+        int prim;
+    };
+
+    void addPieces(const PRIMITIVE *pr, int shape, int prim);
+
+    std::vector<PIECE> m_pieces;
+    std::vector<int> m_shapeFirst;
+    std::vector<int> m_first;
+    std::vector<CROSSING> m_crossings;
+};
@@ -41,7 +41,9 @@ double TERMINAL::distanceTo(const TERMINAL &p2) const {
     return sqrt(dx * dx + dy * dy);
 }
 
-// TODO maybe use atan2 instead of atan with a bunch of extra logic
+// Degrees in [0, 360), counter-clockwise from the positive x axis. This is
+// kept on atan rather than atan2: arcs compare these angles within EP_A, and
+// the last bits atan2 changes are enough to flip a point at an arc's end.
 double TERMINAL::angleTo(const TERMINAL &t2) const {
     const double dx = t2.x - x;
     const double dy = t2.y - y;
@@ -62,5 +64,4 @@ double TERMINAL::angleTo(const TERMINAL &t2) const {
             }
         }
     }
-    return atan(dy / dx) * 180.0f / M_PI;
 }
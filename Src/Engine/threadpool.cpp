@@ -0,0 +1,54 @@
+#include "threadpool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static std::atomic<int> threadCount(0);
+static thread_local bool isWorker = false;
+
+void SetThreadCount(int count)
+{
+    threadCount = count < 0 ? 0 : count;
+}
+
+int GetThreadCount()
+{
+    int n = threadCount;
+    if (n > 0) return n;
+    n = (int)std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Workers are started per call and joined before returning, which keeps the
+// loops free of shared state between calls; the cost is small next to the
+// per-shape work they run.
+void ParallelFor(int count, const std::function<void(int index, int worker)> &body)
+{
+    int workers = GetThreadCount();
+    if (workers > count) workers = count;
+    if (workers <= 1 || isWorker) {
+        for (int i = 0; i < count; i++) {
+            body(i, 0);
+        }
+        return;
+    }
+
+    std::atomic<int> next(0);
+    auto run = [&](int worker) {
+        isWorker = true;
+        for (int i = next++; i < count; i = next++) {
+            body(i, worker);
+        }
+        isWorker = false;
+    };
+
+    std::vector<std::thread> threads;
+    for (int w = 1; w < workers; w++) {
+        threads.push_back(std::thread(run, w));
+    }
+    run(0);
+    for (std::size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <functional>
+
+// Number of worker threads the parallel loops use; 0, the default, means
+// one per hardware thread. 1 runs everything on the calling thread.
+void SetThreadCount(int count);
+int GetThreadCount();
+
+// Calls body(index, worker) once for every index in [0, count), spread over
+// up to GetThreadCount() threads that pull the next index as they finish.
+// worker is below GetThreadCount() and unique among the threads running at
+// the same time, so it can pick per-thread scratch such as an ARENA. Returns
+// after every call has returned; the order of the calls is unspecified.
+// Loops started from inside a body run serially on the calling thread, so
+// nesting them does not multiply the number of threads.
+void ParallelFor(int count, const std::function<void(int index, int worker)> &body);
@@ -0,0 +1,385 @@
+#include "../Engine/arc.h"
+#include "../Engine/global.h"
+#include "../Engine/line.h"
+#include "../Engine/shape.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+enum _GENERATOR_KIND_
+{
+    GENERATOR_POLYGON = 1,
+    GENERATOR_GEAR = 2,
+    GENERATOR_SLOT = 3,
+    GENERATOR_RINGS = 4,
+    GENERATOR_CLUSTER = 5
+};
+
+struct OPTIONS
+{
+    int nKind;
+    long long count;
+    long long bytes;
+    int prims;
+    double overlap;
+    unsigned long long seed;
+    const char *output;
+};
+
+// Every shape fits in a circle of this radius around its own centre.
+static const double SHAPE_RADIUS = 100.0;
+// Concentric contours per group in the rings kind.
+static const int RING_COUNT = 4;
+// Shapes per group in the cluster kind.
+static const int CLUSTER_SIZE = 8;
+
+// mt19937_64 is specified bit for bit, the standard distributions are not,
+// so the doubles are made here to keep a seed's output the same everywhere.
+struct RANDOM
+{
+    std::mt19937_64 engine;
+
+    explicit RANDOM(unsigned long long seed) : engine(seed) {}
+    double uniform(double lo, double hi)
+    {
+        double u = (double)(engine() >> 11) * (1.0 / 9007199254740992.0);
+        return lo + (hi - lo) * u;
+    }
+};
+
+// Places shapes on a square grid; pitch shrinks from a clear gap at overlap 0
+// to every shape on the same spot at overlap 1.
+struct LAYOUT
+{
+    long long columns;
+    double pitch;
+
+    void getCell(long long index, double *x, double *y) const
+    {
+        *x = (double)(index % columns) * pitch;
+        *y = (double)(index / columns) * pitch;
+    }
+};
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+        "usage: %s [options] <output>\n"
+        "\n"
+        "  -k kind     polygon, gear, slot, rings or cluster (default polygon)\n"
+        "  -n count    number of shapes to write (default 100)\n"
+        "  -b size     write as many shapes as fit in size bytes instead; k, m and g\n"
+        "              suffixes multiply by 1024, 1024^2 and 1024^3\n"
+        "  -p prims    primitives per shape (default 16)\n"
+        "  -o overlap  0 keeps shapes apart, 1 puts them all in one place (default 0.3)\n"
+        "  -s seed     random seed (default 1)\n"
+        "\n"
+        "output '-' writes to stdout.\n",
+        program);
+}
+
+static bool parseKind(const char *text, int *ret)
+{
+    static const struct { const char *name; int nKind; } kinds[] = {
+        { "polygon", GENERATOR_POLYGON },
+        { "gear", GENERATOR_GEAR },
+        { "slot", GENERATOR_SLOT },
+        { "rings", GENERATOR_RINGS },
+        { "cluster", GENERATOR_CLUSTER },
+    };
+    for (std::size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(text, kinds[i].name) == 0) {
+            *ret = kinds[i].nKind;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseSize(const char *text, long long *ret)
+{
+    char *end = NULL;
+    double v = strtod(text, &end);
+    if (end == text || v < 0) return false;
+    if (*end == 'k' || *end == 'K') { v *= 1024.0; end++; }
+    else if (*end == 'm' || *end == 'M') { v *= 1024.0 * 1024.0; end++; }
+    else if (*end == 'g' || *end == 'G') { v *= 1024.0 * 1024.0 * 1024.0; end++; }
+    if (*end != '\0') return false;
+    *ret = (long long)v;
+    return true;
+}
+
+static TERMINAL polar(double cx, double cy, double r, double a)
+{
+    return TERMINAL(cx + r * cos(a), cy + r * sin(a));
+}
+
+// Random vertices sorted by angle around the centre, so the outline is star
+// shaped and therefore simple. Counter clockwise, n lines.
+static void makePolygon(double cx, double cy, double radius, int n, RANDOM *rnd, SHAPE *shp)
+{
+    if (n < 3) n = 3;
+    std::vector<TERMINAL> pts;
+    for (int i = 0; i < n; i++) {
+        double a = 2 * M_PI * (i + rnd->uniform(0.1, 0.9)) / n;
+        pts.push_back(polar(cx, cy, radius * rnd->uniform(0.5, 1.0), a));
+    }
+    for (int i = 0; i < n; i++) {
+        shp->prims.push_back(std::make_unique<LINE>(pts[i], pts[(i + 1) % n]));
+    }
+}
+
+// One tooth is a flank, a tip arc, a flank and a root arc, so n / 4 teeth.
+static void makeGear(double cx, double cy, double radius, int n, RANDOM *rnd, SHAPE *shp)
+{
+    int teeth = n / 4 < 3 ? 3 : n / 4;
+    double root = radius * 0.75;
+    double phase = rnd->uniform(0, 2 * M_PI);
+    double w = 2 * M_PI / teeth;
+    TERMINAL c(cx, cy);
+
+    for (int k = 0; k < teeth; k++) {
+        double a = phase + w * k;
+        TERMINAL p0 = polar(cx, cy, root, a);
+        TERMINAL p1 = polar(cx, cy, radius, a + 0.1 * w);
+        TERMINAL p2 = polar(cx, cy, radius, a + 0.5 * w);
+        TERMINAL p3 = polar(cx, cy, root, a + 0.6 * w);
+        TERMINAL p4 = polar(cx, cy, root, a + w);
+        shp->prims.push_back(std::make_unique<LINE>(p0, p1));
+        shp->prims.push_back(std::make_unique<ARC>(c, p1, p2, false));
+        shp->prims.push_back(std::make_unique<LINE>(p2, p3));
+        shp->prims.push_back(std::make_unique<ARC>(c, p3, p4, false));
+    }
+}
+
+// Shallow arc over the chord p1-p2 of a counter clockwise outline, bulging
+// out of the shape or into it.
+static std::unique_ptr<PRIMITIVE> makeBulge(TERMINAL p1, TERMINAL p2, double sagitta, bool outwards)
+{
+    double dx = p2.x - p1.x, dy = p2.y - p1.y;
+    double chord = sqrt(dx * dx + dy * dy);
+    double nx = dy / chord, ny = -dx / chord;
+    double r = (chord * chord / 4 + sagitta * sagitta) / (2 * sagitta);
+    double d = outwards ? -(r - sagitta) : r - sagitta;
+    TERMINAL c((p1.x + p2.x) / 2 + nx * d, (p1.y + p2.y) / 2 + ny * d);
+    return std::make_unique<ARC>(c, p1, p2, !outwards);
+}
+
+// A stadium at a random angle whose long sides are waves of shallow arcs,
+// two half circle caps plus (n - 2) / 2 arcs a side.
+static void makeSlot(double cx, double cy, double radius, int n, RANDOM *rnd, SHAPE *shp)
+{
+    int m = (n - 2) / 2 < 1 ? 1 : (n - 2) / 2;
+    double l = radius * 0.6, w = radius * 0.3;
+    double a = rnd->uniform(0, M_PI);
+    double ca = cos(a), sa = sin(a);
+    std::vector<TERMINAL> bottom, top;
+
+    for (int i = 0; i <= m; i++) {
+        double x = -l + 2 * l * i / m;
+        bottom.push_back(TERMINAL(cx + x * ca + w * sa, cy + x * sa - w * ca));
+        top.push_back(TERMINAL(cx - x * ca - w * sa, cy - x * sa + w * ca));
+    }
+    double sagitta = 0.1 * 2 * l / m;
+    for (int i = 0; i < m; i++) {
+        shp->prims.push_back(makeBulge(bottom[i], bottom[i + 1], sagitta, i % 2 == 0));
+    }
+    shp->prims.push_back(std::make_unique<ARC>(TERMINAL(cx + l * ca, cy + l * sa), bottom[m], top[0], false));
+    for (int i = 0; i < m; i++) {
+        shp->prims.push_back(makeBulge(top[i], top[i + 1], sagitta, i % 2 == 0));
+    }
+    shp->prims.push_back(std::make_unique<ARC>(TERMINAL(cx - l * ca, cy - l * sa), top[m], bottom[0], false));
+}
+
+// The ring-th of RING_COUNT concentric circles of n arcs; odd rings run
+// clockwise so they read as the holes of the even ones.
+static void makeRing(double cx, double cy, double radius, int n, int ring, RANDOM *rnd, SHAPE *shp)
+{
+    if (n < 2) n = 2;
+    double r = radius * (1.0 - 0.2 * ring);
+    bool hole = ring % 2 == 1;
+    TERMINAL c(cx, cy);
+    std::vector<TERMINAL> pts;
+
+    for (int i = 0; i < n; i++) {
+        double a = 2 * M_PI * (i + rnd->uniform(0.2, 0.8)) / n;
+        pts.push_back(polar(cx, cy, r, hole ? -a : a));
+    }
+    for (int i = 0; i < n; i++) {
+        shp->prims.push_back(std::make_unique<ARC>(c, pts[i], pts[(i + 1) % n], hole));
+    }
+}
+
+static void makeShape(const OPTIONS &options, const LAYOUT &layout, long long index, RANDOM *rnd, SHAPE *shp)
+{
+    double x, y;
+    shp->clear();
+
+    switch (options.nKind)
+    {
+    case GENERATOR_POLYGON:
+        layout.getCell(index, &x, &y);
+        makePolygon(x, y, SHAPE_RADIUS, options.prims, rnd, shp);
+        break;
+    case GENERATOR_GEAR:
+        layout.getCell(index, &x, &y);
+        makeGear(x, y, SHAPE_RADIUS, options.prims, rnd, shp);
+        break;
+    case GENERATOR_SLOT:
+        layout.getCell(index, &x, &y);
+        makeSlot(x, y, SHAPE_RADIUS, options.prims, rnd, shp);
+        break;
+    case GENERATOR_RINGS:
+        layout.getCell(index / RING_COUNT, &x, &y);
+        makeRing(x, y, SHAPE_RADIUS, options.prims, (int)(index % RING_COUNT), rnd, shp);
+        break;
+    case GENERATOR_CLUSTER:
+        {
+            // members always overlap; overlap only packs the clusters closer
+            double spread = SHAPE_RADIUS * 0.5;
+            layout.getCell(index / CLUSTER_SIZE, &x, &y);
+            x += rnd->uniform(-spread, spread);
+            y += rnd->uniform(-spread, spread);
+            makePolygon(x, y, SHAPE_RADIUS, options.prims, rnd, shp);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Size of the shape as SHAPE::write2Stream lays it out.
+static long long getShapeBytes(const SHAPE &shp)
+{
+    long long n = sizeof(int);
+    for (std::size_t i = 0; i < shp.prims.size(); i++) {
+        n += sizeof(int) + 4 * sizeof(double);
+        if (shp.prims[i]->nKind == GBAPY_ARC) n += 5 * sizeof(double) + sizeof(bool);
+    }
+    return n;
+}
+
+static long long getGroupSize(int nKind)
+{
+    if (nKind == GENERATOR_RINGS) return RING_COUNT;
+    if (nKind == GENERATOR_CLUSTER) return CLUSTER_SIZE;
+    return 1;
+}
+
+// Shapes are written as they are made, so memory stays flat whatever the
+// file size.
+static bool writeShapes(const OPTIONS &options, FILE *pFile)
+{
+    RANDOM rnd(options.seed);
+    SHAPE shp;
+    long long count = options.count;
+
+    if (options.bytes > 0) {
+        // every shape of a kind has the same primitives, so one sample sizes them all
+        LAYOUT sample = { 1, 0 };
+        RANDOM probe(options.seed);
+        makeShape(options, sample, 0, &probe, &shp);
+        count = (options.bytes - (long long)sizeof(int)) / getShapeBytes(shp);
+        if (count < 1) count = 1;
+    }
+    if (count > INT_MAX) {
+        fprintf(stderr, "%lld shapes do not fit the int shape count\n", count);
+        return false;
+    }
+
+    long long groups = (count + getGroupSize(options.nKind) - 1) / getGroupSize(options.nKind);
+    double clearance = options.nKind == GENERATOR_CLUSTER ? 3.2 : 2.2;
+    LAYOUT layout;
+    layout.columns = (long long)ceil(sqrt((double)groups));
+    layout.pitch = SHAPE_RADIUS * clearance * (1.0 - options.overlap);
+
+    int n = (int)count;
+    if (fwrite(&n, 1, sizeof(int), pFile) != sizeof(int)) return false;
+    for (long long i = 0; i < count; i++) {
+        makeShape(options, layout, i, &rnd, &shp);
+        shp.write2Stream(pFile);
+        if (ferror(pFile)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    OPTIONS options;
+    options.nKind = GENERATOR_POLYGON;
+    options.count = 100;
+    options.bytes = 0;
+    options.prims = 16;
+    options.overlap = 0.3;
+    options.seed = 1;
+    options.output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = true;
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (arg[0] == '-' && arg[1] != '\0') {
+            if (value == NULL || arg[2] != '\0') ok = false;
+            else if (arg[1] == 'k') ok = parseKind(value, &options.nKind);
+            else if (arg[1] == 'n') ok = (options.count = atoll(value)) > 0;
+            else if (arg[1] == 'b') ok = parseSize(value, &options.bytes) && options.bytes > 0;
+            else if (arg[1] == 'p') ok = (options.prims = atoi(value)) > 0;
+            else if (arg[1] == 'o') {
+                options.overlap = atof(value);
+                ok = options.overlap >= 0 && options.overlap <= 1;
+            }
+            else if (arg[1] == 's') options.seed = strtoull(value, NULL, 10);
+            else ok = false;
+            i++;
+        }
+        else if (options.output == NULL) {
+            options.output = arg;
+        }
+        else {
+            ok = false;
+        }
+        if (!ok) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.output == NULL) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    bool toStdout = strcmp(options.output, "-") == 0;
+#ifdef _WIN32
+    if (toStdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    FILE *pFile = toStdout ? stdout : fopen(options.output, "wb");
+    if (pFile == NULL) {
+        fprintf(stderr, "cannot write '%s'\n", options.output);
+        return 2;
+    }
+    setvbuf(pFile, NULL, _IOFBF, 1 << 20);
+
+    bool ok = writeShapes(options, pFile);
+    if (toStdout) ok = fflush(pFile) == 0 && ok;
+    else ok = fclose(pFile) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "cannot write '%s'\n", options.output);
+        return 2;
+    }
+    return 0;
+}
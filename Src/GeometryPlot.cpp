@@ -1,6 +1,12 @@
 #include "GeometryPlot.h"
+#include "engine/boolean.h"
+#include "engine/broadphase.h"
+#include "engine/budget.h"
 #include "engine/core.h"
 #include "engine/global.h"
+#include "engine/offset.h"
+#include "engine/shapefile.h"
+#include "engine/threadpool.h"
 
 #include "engine/terminal.h"
 #include "engine/shape.h"
@@ -21,7 +27,10 @@ static QPointF TERMINALtoQPointF(const TERMINAL &pt);
 static QLineF LINEtoQLineF(const LINE &line);
 static QPainterPath SHAPEtoQPainterPath(const SHAPE &shape);
 
-GeometryPlot::GeometryPlot(QWidget *parent) : QWidget(parent), m_curP(0, 0), m_nShapeKind(-1)
+// How close, in plot units, the cursor has to come to a pivot to snap to it.
+static const double SNAP_RADIUS = 10.0;
+
+GeometryPlot::GeometryPlot(QWidget *parent) : QWidget(parent), m_curP(0, 0), m_nShapeKind(-1), m_nextPivotsId(0), m_layerDirty(true), m_backupCurrent(true), m_cancel(false), m_job(0), m_busy(false)
 {
     QPalette pal = palette();
     pal.setColor(QPalette::Background, Qt::black);
@@ -33,6 +42,9 @@ GeometryPlot::GeometryPlot(QWidget *parent) : QWidget(parent), m_curP(0, 0), m_n
 
 GeometryPlot::~GeometryPlot()
 {
+    // the window may be half gone already, so don't tell it
+    blockSignals(true);
+    StopWorker();
 }
 
 QPointF GeometryPlot::mapToPlot(const QPointF &pt) const
@@ -58,24 +70,13 @@ void GeometryPlot::setTool(int tool)
 
 void GeometryPlot::open(const QString &filePath)
 {
-	FILE *pFile = fopen(filePath.toLatin1(), "rb");
-	if (pFile == NULL) return;
-	int n = 0;
-
-	fread(&n, 1, sizeof(int), pFile);
-	if (n < 0) {
-		fclose(pFile);
-		return;
-	}
+	std::vector<SHAPE> shapes;
+	if (!ReadShapeFile(filePath.toLatin1(), &shapes)) return;
+	StopWorker();
 
 	clear();
 
-	for (int i = 0; i < n; i++) {
-		SHAPE shp;
-		shp.readFromStream(pFile);
-		m_shapes.push_back(shp);
-	}
-	fclose(pFile);
+	m_shapes.swap(shapes);
     BackupShape();
     ExtractSnapPivots();
     update();
@@ -83,22 +84,18 @@ void GeometryPlot::open(const QString &filePath)
 
 void GeometryPlot::save(const QString &filePath)
 {
-	FILE *pFile = fopen(filePath.toLatin1(), "wb");
-	if (pFile == NULL) return;
-	int n = (int)m_shapes.size();
-
-	fwrite(&n, 1, sizeof(int), pFile);
-	for (std::size_t i = 0; i < m_shapes.size(); i++) {
-		m_shapes[i].write2Stream(pFile);
-	}
-	fclose(pFile);
+	WriteShapeFile(filePath.toLatin1(), &m_shapes);
 }
 
 void GeometryPlot::clear()
 {
+    StopWorker();
     setTool(-1);
     m_pivots.clear();;
     m_snapPivots.clear();
+    m_shapePivots.clear();
+    m_pairPivots.clear();
+    m_snapGrid.clear();
     for (std::size_t i = 0; i < m_shapes.size(); i++) {
         m_shapes[i].clear();
     }
@@ -111,7 +108,11 @@ void GeometryPlot::clear()
     m_shapes.clear();
     m_reloadShapes.clear();
     m_GhostShapes.clear();
+    m_shapePaths.clear();
+    m_ghostPaths.clear();
+    m_layerDirty = true;
     m_snap = false;
+    m_backupCurrent = true;
     update();
 }
 
@@ -124,70 +125,112 @@ void GeometryPlot::BooleanButtonFunction()
 
 void GeometryPlot::BackupShape() {
     m_reloadShapes = m_shapes;
+    m_backupCurrent = true;
 }
 
 void GeometryPlot::RestoreShape() {
     m_shapes = m_reloadShapes;
+    m_backupCurrent = true;
 }
 
 void GeometryPlot::offset(double r)
 {
-    for(int n = 0;n < 10;n++) {
-        std::vector<SHAPE> subShapes;
-        for (std::size_t i = 0; i < m_shapes.size(); i++) {
-            m_shapes[i].doOffsetOperation(r/10.0, &subShapes);
-        }
-        if(subShapes.size() > 0) {
-            removeDuplicated(&subShapes);
-        }
-        for (std::size_t i = 0; i < subShapes.size(); i++) {
-            m_shapes.push_back(subShapes[i]);
-        }
-        subShapes.clear();
-        ClearShapes(&m_shapes);
-        doBooleanOPT();
-    }
-    ExtractSnapPivots();
-    update();
+    StartOffset(r, false);
 }
 
 void GeometryPlot::ghostOffset(double r)
 {
-    for(std::size_t i = 0;i < m_shapes.size();i++) {
-        SHAPE sp;
-        for(std::size_t j = 0;j < m_shapes[i].prims.size();j++) {
-            sp.prims.push_back(m_shapes[i].prims[j]->clone());
-        }
-        m_GhostShapes.push_back(sp);
-    }
+    StartOffset(r, true);
+}
 
-    for(int n = 0;n < 10;n++) {
-        std::vector<SHAPE> subShapes;
-        for (std::size_t i = 0; i < m_shapes.size(); i++) {
-            m_shapes[i].doOffsetOperation(r/10.0, &subShapes);
-        }
-        if(subShapes.size() > 0) {
-            removeDuplicated(&subShapes);
-        }
-        for (std::size_t i = 0; i < subShapes.size(); i++) {
-            m_shapes.push_back(subShapes[i]);
+bool GeometryPlot::isBusy() const {
+    return m_busy;
+}
+
+void GeometryPlot::cancel() {
+    m_cancel = true;
+}
+
+// Offsets a copy of the shapes on the worker thread, so the window keeps
+// drawing, and hands the result back to FinishOffset() on this thread.
+// Edits wait until it is done.
+void GeometryPlot::StartOffset(double r, bool ghost) {
+    if (m_busy) return;
+    StopWorker();
+
+    std::shared_ptr<std::vector<SHAPE>> shapes = std::make_shared<std::vector<SHAPE>>(m_shapes);
+    int job = ++m_job;
+    m_cancel = false;
+    m_busy = true;
+    emit operationProgress(0);
+
+    m_worker = std::thread([this, job, shapes, r, ghost]() {
+        BUDGET budget;
+        budget.cancel = &m_cancel;
+        budget.start();
+        int status = OffsetShapes(shapes.get(), r, [this, job](double done, double total) {
+            int percent = total > 0 ? static_cast<int>(100.0 * done / total) : 100;
+            QMetaObject::invokeMethod(this, [this, job, percent]() {
+                if (job == m_job) emit operationProgress(percent);
+            }, Qt::QueuedConnection);
+            return !m_cancel;
+        }, &budget);
+        bool completed = status == BUDGET_OK;
+        QMetaObject::invokeMethod(this, [this, job, shapes, ghost, completed]() {
+            FinishOffset(job, shapes, ghost, completed);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GeometryPlot::FinishOffset(int job, std::shared_ptr<std::vector<SHAPE>> shapes, bool ghost, bool completed) {
+    if (job != m_job) return;
+    if (m_worker.joinable()) m_worker.join();
+    m_busy = false;
+
+    if (completed) {
+        if (ghost) {
+            for(std::size_t i = 0;i < m_shapes.size();i++) {
+                SHAPE sp;
+                for(std::size_t j = 0;j < m_shapes[i].prims.size();j++) {
+                    sp.prims.push_back(m_shapes[i].prims[j]->clone());
+                }
+                m_GhostShapes.push_back(sp);
+            }
         }
-        subShapes.clear();
-        ClearShapes(&m_shapes);
-        doBooleanOPT();
+        m_shapes.swap(*shapes);
+        m_backupCurrent = false;
+        m_shapePaths.clear();
+        m_layerDirty = true;
+
+        ExtractSnapPivots();
+        update();
     }
+    emit operationFinished(completed);
+}
 
-    ExtractSnapPivots();
-    update();
+// Cancels the running offset, if any, and drops its result.
+void GeometryPlot::StopWorker() {
+    if (!m_worker.joinable()) return;
+    m_cancel = true;
+    m_worker.join();
+    m_job++;
+    if (m_busy) {
+        m_busy = false;
+        emit operationFinished(false);
+    }
 }
 
 void GeometryPlot::reload()
 {
+    StopWorker();
 	for (std::size_t i = 0; i < m_GhostShapes.size(); i++) {
 		m_GhostShapes[i].clear();
 	}
 	m_GhostShapes.clear();
+    m_ghostPaths.clear();
     RestoreShape();
+    m_shapePaths.clear();
+    m_layerDirty = true;
     ExtractSnapPivots();
     update();
 }
@@ -196,20 +239,32 @@ void GeometryPlot::paintEvent(QPaintEvent *event)
 {
     Q_UNUSED(event);
 
-    // setup drawing with Y positive being upwards not downwards
+    // draw existing shapes once, into the static layer
+    if (m_layerDirty || m_staticLayer.size() != size()) {
+        UpdatePaths();
+        m_staticLayer = QPixmap(size());
+        m_staticLayer.fill(Qt::black);
+
+        QPainter layer(&m_staticLayer);
+        layer.translate(0, height()-1);
+        layer.scale(1.0, -1.0);
+        layer.setPen(QColor(200, 200, 200));
+        for(std::size_t i = 0;i < m_ghostPaths.size();i++) {
+            layer.drawPath(m_ghostPaths[i]);
+        }
+        for (std::size_t i = 0; i < m_shapePaths.size(); i++) {
+            layer.drawPath(m_shapePaths[i]);
+        }
+        m_layerDirty = false;
+    }
+
     QPainter painter(this);
+    painter.drawPixmap(0, 0, m_staticLayer);
+
+    // setup drawing with Y positive being upwards not downwards
     painter.translate(0, height()-1);
     painter.scale(1.0, -1.0);
 
-    // draw existing shapes
-    painter.setPen(QColor(200, 200, 200));
-    for(std::size_t i = 0;i < m_GhostShapes.size();i++) {
-        painter.drawPath(SHAPEtoQPainterPath(m_GhostShapes[i]));
-    }
-    for (std::size_t i = 0; i < m_shapes.size(); i++) {
-        painter.drawPath(SHAPEtoQPainterPath(m_shapes[i]));
-    }
-
     // draw currently "pen" tool
     DrawShape(&painter);
 }
@@ -218,7 +273,7 @@ void GeometryPlot::mousePressEvent(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton)
     {
-        if (!rect().contains(event->pos()))
+        if (!rect().contains(event->pos()) || m_busy)
             return;
         const QPointF pt(mapToPlot(event->pos()));
         m_curP.x = static_cast<double>(pt.x());
@@ -252,6 +307,7 @@ void GeometryPlot::mouseMoveEvent(QMouseEvent *event)
 
 void GeometryPlot::UpdateShapes() {
     bool bCreated = false;
+    std::vector<int> changed;
 
     switch (m_nShapeKind)
     {
@@ -270,23 +326,28 @@ void GeometryPlot::UpdateShapes() {
             if (prevShapeIndex1 == -1 && prevShapeIndex2 == -1) {
                 sp.prims.push_back(std::make_unique<LINE>(t1, t2));
                 m_shapes.push_back(sp);
+                changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             }
             else if (prevShapeIndex1 == -1) {
                 m_shapes[prevShapeIndex2].prims.push_back(std::make_unique<LINE>(r1, r2));
                 m_shapes[prevShapeIndex2].update();
+                changed.push_back(prevShapeIndex2);
             }
             else if (prevShapeIndex2 == -1) {
                 m_shapes[prevShapeIndex1].prims.push_back(std::make_unique<LINE>(r1, r2));
                 m_shapes[prevShapeIndex1].update();
+                changed.push_back(prevShapeIndex1);
             }
             else if (prevShapeIndex1 == prevShapeIndex2) {
                 m_shapes[prevShapeIndex1].prims.push_back(std::make_unique<LINE>(r1, r2));
                 m_shapes[prevShapeIndex1].update();
+                changed.push_back(prevShapeIndex1);
             }
             else{
                 m_shapes[prevShapeIndex1].prims.push_back(std::make_unique<LINE>(r1, r2));
-                MergeShape(prevShapeIndex1, prevShapeIndex2);
-                m_shapes[prevShapeIndex1].update();
+                int index = MergeShape(prevShapeIndex1, prevShapeIndex2);
+                m_shapes[index].update();
+                changed.push_back(index);
             }
             m_pivots.clear();
             m_pivots.push_back(t2);
@@ -314,6 +375,7 @@ void GeometryPlot::UpdateShapes() {
             shp.update();
 
             m_shapes.push_back(shp);
+            changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             m_pivots.clear();
             bCreated = true;
         }
@@ -367,6 +429,7 @@ void GeometryPlot::UpdateShapes() {
             shp.update();
 
             m_shapes.push_back(shp);
+            changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             m_pivots.clear();
             bCreated = true;
         }
@@ -394,9 +457,13 @@ void GeometryPlot::UpdateShapes() {
             shp.prims[1]->terms[0] = shp.prims[0]->terms[1];
             shp.prims[2]->terms[0] = shp.prims[1]->terms[1];
             shp.prims[3]->terms[0] = shp.prims[2]->terms[1];
+            for (int i = 0; i < 4; i++) {
+                static_cast<ARC *>(shp.prims[i].get())->updateCache();
+            }
             shp.update();
 
             m_shapes.push_back(shp);
+            changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             m_pivots.clear();
             bCreated = true;
         }
@@ -426,6 +493,7 @@ void GeometryPlot::UpdateShapes() {
                         std::make_unique<LINE>(shp.prims[2]->terms[1], shp.prims[0]->terms[0]));
             shp.update();
             m_shapes.push_back(shp);
+            changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             m_pivots.clear();
             bCreated = true;
         }
@@ -451,6 +519,7 @@ void GeometryPlot::UpdateShapes() {
             shp1.update();
 
             m_shapes.push_back(shp1);
+            changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             if (r - delta > 0) {
                 SHAPE shp2;
                 r -= delta;
@@ -465,6 +534,7 @@ void GeometryPlot::UpdateShapes() {
                 shp2.update();
 
                 m_shapes.push_back(shp2);
+                changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             }
             m_pivots.clear();
             bCreated = true;
@@ -505,27 +575,32 @@ void GeometryPlot::UpdateShapes() {
                 shp.prims.push_back(
                             std::make_unique<ARC>(p0, p1, p2, true));
                 m_shapes.push_back(shp);
+                changed.push_back(static_cast<int>(m_shapes.size()) - 1);
             }
             else if (prevShapeIndex1 == -1) {
                 m_shapes[prevShapeIndex2].prims.push_back(
                             std::make_unique<ARC>(p0, p1, p2, true));
                 m_shapes[prevShapeIndex2].update();
+                changed.push_back(prevShapeIndex2);
             }
             else if (prevShapeIndex2 == -1) {
                 m_shapes[prevShapeIndex1].prims.push_back(
                             std::make_unique<ARC>(p0, p1, p2, true));
                 m_shapes[prevShapeIndex1].update();
+                changed.push_back(prevShapeIndex1);
             }
             else if (prevShapeIndex1 == prevShapeIndex2) {
                 m_shapes[prevShapeIndex1].prims.push_back(
                             std::make_unique<ARC>(p0, p1, p2, true));
                 m_shapes[prevShapeIndex1].update();
+                changed.push_back(prevShapeIndex1);
             }
             else{
                 m_shapes[prevShapeIndex1].prims.push_back(
                             std::make_unique<ARC>(p0, p1, p2, true));
-                MergeShape(prevShapeIndex1, prevShapeIndex2);
-                m_shapes[prevShapeIndex1].update();
+                int index = MergeShape(prevShapeIndex1, prevShapeIndex2);
+                m_shapes[index].update();
+                changed.push_back(index);
             }
 
             m_pivots.clear();
@@ -536,9 +611,7 @@ void GeometryPlot::UpdateShapes() {
         break;
     }
     if (bCreated) {
-        doBooleanOPT();
-        BackupShape();
-        ExtractSnapPivots();
+        doChangedBooleanOPT(&changed);
     }
 }
 
@@ -561,84 +634,188 @@ int GeometryPlot::FindShape(const TERMINAL &t, PTERMINAL ret) {
     return -1;
 }
 
-void GeometryPlot::MergeShape(int index1, int index2) {
+// Returns where the merged shape ends up once index2 is gone.
+int GeometryPlot::MergeShape(int index1, int index2) {
     m_shapes[index1].prims.insert(m_shapes[index1].prims.end(),
                                   std::make_move_iterator(m_shapes[index2].prims.begin()),
                                   std::make_move_iterator(m_shapes[index2].prims.end()));
     RemoveShape(index2);
+    return index2 < index1 ? index1 - 1 : index1;
 }
 
+// The backup and the pivots follow while they still mirror m_shapes, so
+// doChangedBooleanOPT() only has to deal with the changed shapes.
 void GeometryPlot::RemoveShape(int index) {
     m_shapes.erase(m_shapes.begin() + index);
+    if (m_backupCurrent && (std::size_t)index < m_reloadShapes.size()) {
+        m_reloadShapes.erase(m_reloadShapes.begin() + index);
+    }
+    RemoveShapePivots(index);
+    if ((std::size_t)index < m_shapePaths.size()) {
+        m_shapePaths.erase(m_shapePaths.begin() + index);
+    }
+    m_layerDirty = true;
 }
 
 bool GeometryPlot::GetNearestTerminal(PTERMINAL p) {
     TERMINAL mnt;
-    double mn = -1.0f;
 
-    if (m_snapPivots.size() == 0) return false;
+    if (!m_snapGrid.findNearest(*p, SNAP_RADIUS, &mnt)) return false;
+    p->x = mnt.x;
+    p->y = mnt.y;
+    return true;
+}
+
+void GeometryPlot::ExtractSnapPivots() {
+    m_shapePivots.clear();
+    m_pairPivots.clear();
+    AddSnapPivots(0);
+}
+
+// Computes the pivots of the shapes from first on and of their pairs with
+// every shape whose box they overlap, keeping what is known of the others.
+void GeometryPlot::AddSnapPivots(int first) {
+    int count = static_cast<int>(m_shapes.size());
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<char> used(count, 0);
+
+    m_shapePivots.resize(count);
+    for (int i = first; i < count; i++) {
+        m_shapePivots[i].id = m_nextPivotsId++;
+        used[i] = 1;
+    }
+
+    std::vector<std::pair<int, int>> overlaps;
+    FindOverlappingShapes(&m_shapes, &overlaps);
+    for (std::size_t k = 0; k < overlaps.size(); k++) {
+        if (overlaps[k].second < first) continue;
+        pairs.push_back(overlaps[k]);
+        used[overlaps[k].first] = 1;
+    }
 
-    for (std::size_t i = 0; i < m_snapPivots.size(); i++) {
-        TERMINAL t = m_snapPivots[i];
-        double d = t.distanceTo(*p);
+    // The trees are built lazily, so build them before the threads share them.
+    for (int i = 0; i < count; i++) {
+        if (used[i]) m_shapes[i].getTree();
+    }
 
-        if (i == 0) {
-            mn = d;
-            mnt = t;
+    int owned = count - first;
+    std::vector<std::vector<TERMINAL>> crossings(pairs.size());
+    ParallelFor(owned + static_cast<int>(pairs.size()), [&](int index, int) {
+        if (index < owned) {
+            ExtractShapePivots(first + index, &m_shapePivots[first + index].pivots);
         }
-        else{
-            if (d < mn) {
-                mn = d;
-                mnt = t;
-            }
+        else {
+            const std::pair<int, int> &pr = pairs[index - owned];
+            ExtractPairPivots(pr.first, pr.second, &crossings[index - owned]);
         }
+    });
+
+    for (std::size_t k = 0; k < pairs.size(); k++) {
+        if (crossings[k].empty()) continue;
+        int id1 = m_shapePivots[pairs[k].first].id;
+        int id2 = m_shapePivots[pairs[k].second].id;
+        m_pairPivots[std::make_pair(std::min(id1, id2), std::max(id1, id2))].swap(crossings[k]);
     }
-    if (mn < 10.0f) {
-        p->x = mnt.x;
-        p->y = mnt.y;
-        return true;
-    }
-    return false;
+    FlattenSnapPivots();
 }
 
-void GeometryPlot::ExtractSnapPivots() {
-    if (m_shapes.size() == 0) return;
-    m_snapPivots.clear();
-    for (std::size_t i = 0; i < m_shapes.size(); i++) {
-        for (std::size_t j = 0; j < m_shapes[i].prims.size(); j++) {
+// Endpoints and centers of the shape's primitives, and the points where
+// they cross each other.
+void GeometryPlot::ExtractShapePivots(int index, std::vector<TERMINAL> *pivots) {
+    SHAPE &shp = m_shapes[index];
+    const BVH &tree = shp.getTree();
+
+    pivots->clear();
+    for (std::size_t j = 0; j < shp.prims.size(); j++) {
+        TERMINAL mn, mx;
+
+        pivots->push_back(shp.prims[j]->terms[0]);
+        pivots->push_back(shp.prims[j]->terms[1]);
+        pivots->push_back(shp.prims[j]->center);
+        shp.prims[j]->getBoundingBox(&mn, &mx);
+        tree.visit(mn, mx, [&](int k) {
+            if ((std::size_t)k <= j) return;
             TERMINAL st1;
             TERMINAL st2;
+            if (isConflict(shp.prims[j].get(), shp.prims[k].get(), &st1, &st2)) {
+                if (st1.isValid) pivots->push_back(st1);
+                if (st2.isValid) pivots->push_back(st2);
+            }
+        });
+    }
+}
 
-            m_snapPivots.push_back(m_shapes[i].prims[j]->terms[0]);
-            m_snapPivots.push_back(m_shapes[i].prims[j]->terms[1]);
-            m_snapPivots.push_back(m_shapes[i].prims[j]->center);
-            for (std::size_t k = 0; k < m_shapes[i].prims.size(); k++) {
-                if (j == k) continue;
+// Points where the primitives of two shapes cross.
+void GeometryPlot::ExtractPairPivots(int index1, int index2, std::vector<TERMINAL> *pivots) {
+    SHAPE &shp1 = m_shapes[index1];
+    SHAPE &shp2 = m_shapes[index2];
+    const BVH &tree = shp2.getTree();
 
+    pivots->clear();
+    for (std::size_t j = 0; j < shp1.prims.size(); j++) {
+        TERMINAL mn, mx;
 
-                if (isConflict(m_shapes[i].prims[j].get(), m_shapes[i].prims[k].get(), &st1, &st2)) {
-                    if (st1.isValid) m_snapPivots.push_back(st1);
-                    if (st2.isValid) m_snapPivots.push_back(st2);
-                }
-            }
-            for (std::size_t k = 0; k < m_shapes.size(); k++) {
-                if (i == k) continue;
-                for (std::size_t n = 0; n < m_shapes[k].prims.size(); n++) {
-                    if (isConflict(m_shapes[i].prims[j].get(), m_shapes[k].prims[n].get(), &st1, &st2)) {
-                        if (st1.isValid) m_snapPivots.push_back(st1);
-                        if (st2.isValid) m_snapPivots.push_back(st2);
-                    }
-                }
+        shp1.prims[j]->getBoundingBox(&mn, &mx);
+        tree.visit(mn, mx, [&](int k) {
+            TERMINAL st1;
+            TERMINAL st2;
+            if (isConflict(shp1.prims[j].get(), shp2.prims[k].get(), &st1, &st2)) {
+                if (st1.isValid) pivots->push_back(st1);
+                if (st2.isValid) pivots->push_back(st2);
             }
-        }
+        });
     }
 }
 
+// Drops the pivots of a shape about to leave m_shapes, with those of every
+// pair it was part of.
+void GeometryPlot::RemoveShapePivots(int index) {
+    if ((std::size_t)index >= m_shapePivots.size()) return;
+    int id = m_shapePivots[index].id;
+    m_shapePivots.erase(m_shapePivots.begin() + index);
+    for (auto it = m_pairPivots.begin(); it != m_pairPivots.end();) {
+        if (it->first.first == id || it->first.second == id) it = m_pairPivots.erase(it);
+        else ++it;
+    }
+}
+
+static bool isPivotLess(const TERMINAL &t1, const TERMINAL &t2) {
+    return t1.x < t2.x || (t1.x == t2.x && t1.y < t2.y);
+}
+
+// Shared endpoints and crossings found from both sides show up more than
+// once, so the list is sorted and the repeats dropped.
+void GeometryPlot::FlattenSnapPivots() {
+    m_snapPivots.clear();
+    for (std::size_t i = 0; i < m_shapePivots.size(); i++) {
+        const std::vector<TERMINAL> &pivots = m_shapePivots[i].pivots;
+        m_snapPivots.insert(m_snapPivots.end(), pivots.begin(), pivots.end());
+    }
+    for (auto it = m_pairPivots.begin(); it != m_pairPivots.end(); ++it) {
+        m_snapPivots.insert(m_snapPivots.end(), it->second.begin(), it->second.end());
+    }
+    std::sort(m_snapPivots.begin(), m_snapPivots.end(), isPivotLess);
+    m_snapPivots.erase(std::unique(m_snapPivots.begin(), m_snapPivots.end(),
+        [](const TERMINAL &t1, const TERMINAL &t2) { return t1.isEqual(t2); }), m_snapPivots.end());
+    m_snapGrid.build(m_snapPivots, SNAP_RADIUS);
+}
+
 void GeometryPlot::DrawShape(QPainter *painter)
 {
     DrawCurrentPen(painter); // draw actively used cursor/tool
 }
 
+// Paths are only built for shapes added since the last paint; whatever
+// reshapes an existing shape drops its path, or all of them.
+void GeometryPlot::UpdatePaths() {
+    for (std::size_t i = m_ghostPaths.size(); i < m_GhostShapes.size(); i++) {
+        m_ghostPaths.push_back(SHAPEtoQPainterPath(m_GhostShapes[i]));
+    }
+    for (std::size_t i = m_shapePaths.size(); i < m_shapes.size(); i++) {
+        m_shapePaths.push_back(SHAPEtoQPainterPath(m_shapes[i]));
+    }
+}
+
 static QPointF TERMINALtoQPointF(const TERMINAL &pt)
 {
     return QPointF(pt.x, pt.y);
@@ -659,7 +836,7 @@ static QPainterPath SHAPEtoQPainterPath(const SHAPE &shape)
         {
             case GBAPY_LINE:
             {
-                const LINE * const line = dynamic_cast<const LINE*>(prim);
+                const LINE * const line = static_cast<const LINE*>(prim);
                 // if (it == shape.prims.begin())
                     path.moveTo(TERMINALtoQPointF(line->terms[0]));
                 path.lineTo(TERMINALtoQPointF(line->terms[1]));
@@ -668,7 +845,7 @@ static QPainterPath SHAPEtoQPainterPath(const SHAPE &shape)
 
             case GBAPY_ARC:
             {
-                const ARC * const arc = dynamic_cast<const ARC*>(prim);
+                const ARC * const arc = static_cast<const ARC*>(prim);
                 double sa = arc->startAngle;
                 double ea = arc->endAngle;
 
@@ -887,162 +1064,40 @@ void GeometryPlot::DrawCurrentPen(QPainter *painter)
     }
 }
 
-bool GeometryPlot::getIntersection(int shpIndex, PRIMITIVE *pr, TERMINAL *t, int *retIndex, int *retShapeIndex, SHAPE **shp) {
-    double mn = M_INFINITE;
-    bool ret = false;
-    int idx;
-    TERMINAL p;
-    for (std::size_t i = 0; i < m_shapes.size(); i++) {
-        if ((int)i == shpIndex) continue;
-        if (m_shapes[i].isIntersected == false) continue;
-        if (m_shapes[i].isCompleted == false) continue;
-        if (m_shapes[i].getSelfIntersection(-1, pr, &p, &idx)) {
-            double m = p.distanceTo(pr->terms[0]);
-            if (m < mn) {
-                *shp = &(m_shapes[i]);
-                mn = m;
-                *retIndex = idx;
-                *retShapeIndex = i;
-                *t = p;
-                ret = true;
-            }
-        }
-    }
-    return ret;
-}
-
-bool GeometryPlot::IsIntersected(SHAPE *shp1, SHAPE *shp2) {
-    for (std::size_t i = 0; i < shp1->prims.size(); i++) {
-        TERMINAL t;
-        int index;
-        if (shp2->getSelfIntersection(-1, shp1->prims[i].get(), &t, &index)) {
-            return true;
+// Merges the shapes just drawn or extended with the ones they touch. Only
+// those shapes leave m_shapes and the results are added at the end, so the
+// backup and the pivots of every other shape stay as they are: no shape
+// left alone has a box overlapping any that was taken out, so none of
+// them can cross the results either.
+void GeometryPlot::doChangedBooleanOPT(std::vector<int> *changed) {
+    BOOLEANENGINE engine;
+    std::size_t count = m_shapes.size();
+
+    engine.executeChanged(&m_shapes, changed);
+    std::size_t first = count - changed->size();
+
+    if (m_backupCurrent) {
+        for (int k = static_cast<int>(changed->size()) - 1; k >= 0; k--) {
+            std::size_t i = changed->at(k);
+            if (i < m_reloadShapes.size()) m_reloadShapes.erase(m_reloadShapes.begin() + i);
         }
+        m_reloadShapes.insert(m_reloadShapes.end(), m_shapes.begin() + first, m_shapes.end());
     }
-    return false;
-}
-
-bool GeometryPlot::doShapeBooleanOPT(SHAPE *shp, int shpIndex, std::vector<SHAPE> *subShapes) {
-    bool retFlag = false;
-
-    for (std::size_t i = 0; i < shp->prims.size(); i++) {
-        TERMINAL t;
-        SHAPE *intersected = NULL;
-        int primIndex;
-        int otherShapeIndex;
-        std::unique_ptr<PRIMITIVE> pr = shp->prims[i]->clone();
-
-        if (pr == NULL) continue;
-        while(getIntersection(shpIndex, pr.get(), &t, &primIndex, &otherShapeIndex, &intersected)) {
-            SHAPE tshp;
-            TERMINAL st = pr->terms[0];
-            TERMINAL et = t;
-            std::unique_ptr<PRIMITIVE> prim = shp->prims[i]->clone(st, et);
-
-            pr.reset(nullptr);
-            retFlag = true;
-
-            if (prim == NULL) break;
-            if (m_shapes[otherShapeIndex].isInsidePoint(prim.get(), primIndex))
-            {
-                prim.reset(nullptr);
-                pr = shp->prims[i]->clone(et);
-                if (pr == NULL) break;
-                continue;
-            }
-
-            tshp.prims.push_back(std::move(prim));
-            while (true)
-            {
-                int m = primIndex;
-                std::unique_ptr<PRIMITIVE> pr1 = intersected->prims[primIndex]->clone(t);
-                if (pr1 == NULL) break;
-                if (getIntersection(otherShapeIndex, pr1.get(), &t, &primIndex, &otherShapeIndex, &intersected)) {
-					std::unique_ptr<PRIMITIVE> pr2 = pr1->clone(pr1->terms[0], t);
-					if (pr2 == NULL) break;
-                    tshp.prims.push_back(std::move(pr2));
-                }
-                else{
-                    tshp.prims.push_back(pr1->clone());
-                    primIndex = m;
-                    primIndex++;
-                    if ((std::size_t)primIndex >= intersected->prims.size()) primIndex = 0;
-                    t = pr1->terms[1];
-                }
-                pr1.reset(nullptr);
-                if (t.isEqual(st)) break;
-            }
-            tshp.update();
-			if (tshp.isCompleted)
-				subShapes->push_back(tshp);
-			else {
-				tshp.clear();
-				tshp.prims.clear();
-			}
-            pr = shp->prims[i]->clone(et);
-            if (pr == NULL) break;
-        }
-        if(pr != NULL) pr.reset(nullptr);
-    }
-    if (subShapes->size() > 1) {
-        removeDuplicated(subShapes);
-    }
-    if (retFlag == false) {
-        int n = 0;
-        for (std::size_t i = 0; i < m_shapes.size(); i++) {
-            if (static_cast<int>(i) == shpIndex) continue;
-            SHAPE *cloneShape = m_shapes[i].clone();
-            if (cloneShape->isPositive == false) {
-                cloneShape->turnPrimitiveOut();
-            }
-            if (cloneShape->isInsideShape(shp)) {
-                n += m_shapes[i].isPositive ? +1 : -1;
-            }
-            cloneShape->clear();
-            delete cloneShape;
-        }
-        if (shp->isPositive) n++;
-        if(n > 1) shp->isValid = false;
-    }
-    return retFlag;
-}
-
-void GeometryPlot::doBooleanOPT() {
-    if (m_shapes.size() < 2) return;
-    std::vector<SHAPE> newShapes;
-
-    for (std::size_t i = 0; i < m_shapes.size(); i++) {
-        m_shapes[i].isIntersected = true;
+    else {
+        BackupShape();
     }
 
-    for (std::size_t i = 0; i < m_shapes.size(); i++) {
-        if (m_shapes[i].isCompleted == false) {
-            newShapes.push_back(m_shapes[i]);
-            continue;
-        }
-        std::vector<SHAPE> subShapes;
-
-        bool ret = doShapeBooleanOPT(&(m_shapes[i]), i, &subShapes);
-
-        if (subShapes.size() > 0 || ret == true) {
-            m_shapes[i].isValid = false;
-            m_shapes[i].isIntersected = true;
-            for (std::size_t j = 0; j < subShapes.size(); j++) {
-                newShapes.push_back(subShapes[j]);
-            }
-        }
-        else if(m_shapes[i].isValid) {
-            newShapes.push_back(m_shapes[i]);
-            m_shapes[i].isIntersected = false;
-        }
+    for (int k = static_cast<int>(changed->size()) - 1; k >= 0; k--) {
+        std::size_t i = changed->at(k);
+        if (i < m_shapePaths.size()) m_shapePaths.erase(m_shapePaths.begin() + i);
+        RemoveShapePivots(changed->at(k));
     }
-    ClearShapes(&m_shapes);
-    ExtractSnapPivots();
-    m_shapes.clear();
-    removeDuplicated(&newShapes);
-    for (std::size_t i = 0; i < newShapes.size(); i++) {
-        m_shapes.push_back(newShapes[i]);
+    m_layerDirty = true;
+    if (m_shapePivots.size() != first) {
+        ExtractSnapPivots();
+        return;
     }
+    AddSnapPivots(static_cast<int>(first));
 }
 
 } // namespace BooleanOffset
@@ -3,9 +3,17 @@
 
 #include "engine/terminal.h"
 #include "engine/shape.h"
+#include "engine/pointgrid.h"
 
 #include <QWidget>
+#include <QPainterPath>
+#include <QPixmap>
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
 #include <vector>
 
 namespace BooleanOffset {
@@ -23,15 +31,21 @@ public:
 
     void open(const QString &filePath);
     void save(const QString &filePath);
+    bool isBusy() const;
 public slots:
     void clear();
     void BooleanButtonFunction();
     void offset(double r);
     void ghostOffset(double r);
     void reload();
+    void cancel();
 signals:
     void pointHovered(const QPointF &);
     void toolChanged(int);
+    // An offset runs on a worker thread; it reports how far it got in
+    // percent and whether it ran to the end or was cancelled.
+    void operationProgress(int percent);
+    void operationFinished(bool completed);
 protected:
 
     void paintEvent(QPaintEvent *event) override;
@@ -41,28 +55,60 @@ protected:
 
     void UpdateShapes();
     int FindShape(const TERMINAL &t, PTERMINAL ret);
-    void MergeShape(int index1, int index2);
+    int MergeShape(int index1, int index2);
     void RemoveShape(int index);
     bool GetNearestTerminal(PTERMINAL p);
     void ExtractSnapPivots();
+    void AddSnapPivots(int first);
+    void ExtractShapePivots(int index, std::vector<TERMINAL> *pivots);
+    void ExtractPairPivots(int index1, int index2, std::vector<TERMINAL> *pivots);
+    void RemoveShapePivots(int index);
+    void FlattenSnapPivots();
+    void UpdatePaths();
     void DrawShape(QPainter *painter);
     void DrawCurrentPen(QPainter *painter);
-    bool getIntersection(int shpIndex, PRIMITIVE *pr, TERMINAL *t, int *retIndex, int *retShapeIndex, SHAPE **shp);
-    bool IsIntersected(SHAPE *shp1, SHAPE *shp2);
-    bool doShapeBooleanOPT(SHAPE *shp, int shpIndex, std::vector<SHAPE> *subShapes);
 
-    void doBooleanOPT();
+    void doChangedBooleanOPT(std::vector<int> *changed);
     void BackupShape();
     void RestoreShape();
+    void StartOffset(double r, bool ghost);
+    void FinishOffset(int job, std::shared_ptr<std::vector<SHAPE>> shapes, bool ghost, bool completed);
+    void StopWorker();
 
     TERMINAL m_curP;
     int m_nShapeKind;
     std::vector<TERMINAL> m_pivots;
     std::vector<TERMINAL> m_snapPivots;
+    // Snap pivots of each shape on its own, and the crossings of each pair
+    // of shapes keyed by the ids of the two, lower first.
+    struct SHAPEPIVOTS
+    {
+        int id;
+        std::vector<TERMINAL> pivots;
+    };
+    std::vector<SHAPEPIVOTS> m_shapePivots;
+    std::map<std::pair<int, int>, std::vector<TERMINAL>> m_pairPivots;
+    int m_nextPivotsId;
+    POINTGRID m_snapGrid;
     std::vector<SHAPE> m_shapes;
     std::vector<SHAPE> m_reloadShapes;
     std::vector<SHAPE> m_GhostShapes;
+    // Render paths of the first shapes of m_shapes and m_GhostShapes; the
+    // rest are built by the next paint.
+    std::vector<QPainterPath> m_shapePaths;
+    std::vector<QPainterPath> m_ghostPaths;
+    // Shapes and ghosts as last painted, under the cursor and the pen; only
+    // redrawn once m_layerDirty says they changed.
+    QPixmap m_staticLayer;
+    bool m_layerDirty;
     bool m_snap;
+    bool m_backupCurrent;
+    // The offset worker and the number of the job it runs; results and
+    // progress of any other job are stale and dropped.
+    std::thread m_worker;
+    std::atomic<bool> m_cancel;
+    int m_job;
+    bool m_busy;
 };
 
 } // namespace BooleanOffset
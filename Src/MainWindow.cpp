@@ -1,6 +1,7 @@
 #include <QtWidgets>
 #include <QMenu>
 #include <QLabel>
+#include <QProgressBar>
 #include <QSettings>
 
 #include "MainWindow.h"
@@ -15,6 +16,7 @@ MainWindow::MainWindow(QWidget *parent) :
     _actions(new Actions(this)),
     _geomPlot(new GeometryPlot),
     _coordinateLabel(new QLabel),
+    _progressBar(new QProgressBar),
     _settings(new QSettings(QCoreApplication::organizationName(), QCoreApplication::applicationName()))
 {
     {
@@ -37,6 +39,7 @@ MainWindow::MainWindow(QWidget *parent) :
         operationMenu->addAction(_actions->operationBoolean);
         operationMenu->addAction(_actions->operationOffsetOut);
         operationMenu->addAction(_actions->operationOffsetIn);
+        operationMenu->addAction(_actions->operationCancel);
         operationMenu->addSeparator();
         operationMenu->addAction(_actions->operationGhostMode);
         operationMenu->addSeparator();
@@ -69,6 +72,10 @@ MainWindow::MainWindow(QWidget *parent) :
         toolbar->addAction(_actions->fileQuit);
         addToolBar(Qt::RightToolBarArea, toolbar);
     }
+    _progressBar->setRange(0, 100);
+    _progressBar->setMaximumWidth(160);
+    _progressBar->hide();
+    statusBar()->addPermanentWidget(_progressBar);
     statusBar()->addPermanentWidget(_coordinateLabel);
     setCentralWidget(_geomPlot);
     layout()->setSizeConstraint(QLayout::SetFixedSize);
@@ -96,6 +103,9 @@ MainWindow::MainWindow(QWidget *parent) :
             _geomPlot->offset(-OFFSET_RADIUS);
     });
     connect(_actions->operationReload, &QAction::triggered, _geomPlot, &GeometryPlot::reload);
+    connect(_actions->operationCancel, &QAction::triggered, _geomPlot, &GeometryPlot::cancel);
+    connect(_geomPlot, &GeometryPlot::operationProgress, this, &MainWindow::slot_OperationProgress);
+    connect(_geomPlot, &GeometryPlot::operationFinished, this, &MainWindow::slot_OperationFinished);
     connect(_geomPlot, &GeometryPlot::pointHovered, this, &MainWindow::slot_CoordinateHovered);
     connect(_geomPlot, &GeometryPlot::toolChanged, this, &MainWindow::slot_ToolChanged);
 
@@ -151,6 +161,25 @@ void MainWindow::slot_CoordinateHovered(const QPointF &pt)
     _coordinateLabel->setText(QString("X: ") + QString::number(pt.x()) + ", Y: "+ QString::number(pt.y()));
 }
 
+void MainWindow::slot_OperationProgress(int percent)
+{
+    _progressBar->setValue(percent);
+    _progressBar->show();
+    _actions->operationOffsetOut->setEnabled(false);
+    _actions->operationOffsetIn->setEnabled(false);
+    _actions->operationCancel->setEnabled(true);
+}
+
+void MainWindow::slot_OperationFinished(bool completed)
+{
+    _progressBar->hide();
+    _actions->operationOffsetOut->setEnabled(true);
+    _actions->operationOffsetIn->setEnabled(true);
+    _actions->operationCancel->setEnabled(false);
+    if (!completed)
+        statusBar()->showMessage("Offset cancelled", 3000);
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     _saveSettings();
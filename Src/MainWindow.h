@@ -7,6 +7,7 @@ QT_BEGIN_NAMESPACE
 class QActionGroup;
 class QSettings;
 class QLabel;
+class QProgressBar;
 QT_END_NAMESPACE
 
 namespace BooleanOffset {
@@ -26,6 +27,8 @@ protected slots:
     void slot_ToolSelected(QAction *act);
     void slot_ToolChanged(int newTool);
     void slot_CoordinateHovered(const QPointF &pt);
+    void slot_OperationProgress(int percent);
+    void slot_OperationFinished(bool completed);
 protected:
     void closeEvent(QCloseEvent *event);
     void _saveSettings();
@@ -34,6 +37,7 @@ protected:
     Actions *_actions;
     GeometryPlot *_geomPlot;
     QLabel *_coordinateLabel;
+    QProgressBar *_progressBar;
     QString _currentDirectory;
     QSettings *_settings;
 };
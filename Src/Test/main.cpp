@@ -0,0 +1,415 @@
+#include "../Engine/arc.h"
+#include "../Engine/boolean.h"
+#include "../Engine/global.h"
+#include "../Engine/line.h"
+#include "../Engine/offset.h"
+#include "../Engine/shape.h"
+#include "../Engine/shapefile.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+struct PRIMDATA
+{
+    int nKind;
+    double x1, y1, x2, y2;
+    double cx, cy, radius, startAngle, endAngle;
+    bool clockWise;
+};
+
+// Shape 221 of "gen -k polygon -n 400 -s 3 -o 0", a plain 16-edge polygon.
+static const PRIMDATA POLYGON_P400[] = {
+    { GBAPY_LINE, 300.84259708090224, 2449.4598249183546, 303.34832590695993, 2459.0580261261348, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 303.34832590695993, 2459.0580261261348, 268.89393920350608, 2482.737174554798, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 268.89393920350608, 2482.737174554798, 232.64872664113892, 2469.4891648636285, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 232.64872664113892, 2469.4891648636285, 200.41487160342061, 2511.5833020431264, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 200.41487160342061, 2511.5833020431264, 173.5952748573232, 2508.5494787030843, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 173.5952748573232, 2508.5494787030843, 137.89370810989141, 2472.1729055851711, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 137.89370810989141, 2472.1729055851711, 139.81585359652996, 2444.9372778910747, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 139.81585359652996, 2444.9372778910747, 156.8888223919715, 2397.5110267254081, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 156.8888223919715, 2397.5110267254081, 162.47588648033769, 2384.145867466731, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 162.47588648033769, 2384.145867466731, 180.55286879094129, 2338.322204960461, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 180.55286879094129, 2338.322204960461, 210.47440932468126, 2352.7399370300909, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 210.47440932468126, 2352.7399370300909, 235.53161164841578, 2336.8695183329141, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 235.53161164841578, 2336.8695183329141, 258.24698581287572, 2346.2350140795893, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 258.24698581287572, 2346.2350140795893, 294.2152360897702, 2356.0247625049692, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 294.2152360897702, 2356.0247625049692, 276.74945273059723, 2409.8725354595281, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 276.74945273059723, 2409.8725354595281, 300.84259708090224, 2449.4598249183546, 0, 0, 0, 0, 0, false },
+};
+
+// The same polygon after the first 0.3 step of "offset 3": r=0.3 arcs at
+// its corners, and one of 179.4 degrees where two corners were cut off.
+static const PRIMDATA POLYGON_P400_STEP[] = {
+    { GBAPY_ARC, 301.09886661409638, 2449.3038572090154, 301.1328685908166, 2449.3840459599819, 300.84259708090224, 2449.4598249183546, 0.30000000000005012, 328.6749682039154, 345.3687853100256, false },
+    { GBAPY_LINE, 301.1328685908166, 2449.3840459599819, 303.63859741687429, 2458.9822471677621, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 303.63859741687429, 2458.9822471677621, 303.51824438837281, 2459.305266312339, 303.34832590695993, 2459.0580261261348, 0.29999999999995541, 345.3687853100256, 55.500785529199156, false },
+    { GBAPY_LINE, 303.51824438837281, 2459.305266312339, 269.06385768491896, 2482.9844147410022, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 269.06385768491896, 2482.9844147410022, 268.79094999882358, 2483.0189425865524, 268.89393920350608, 2482.737174554798, 0.29999999999984089, 55.500785529199156, 110.07789421980637, false },
+    { GBAPY_LINE, 268.79094999882358, 2483.0189425865524, 232.75284755796113, 2469.8466338418771, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 232.75284755796113, 2469.8466338418771, 200.65305816181257, 2511.7656949251186, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 200.65305816181257, 2511.7656949251186, 200.38115077007674, 2511.8814008613035, 200.41487160342061, 2511.5833020431264, 0.30000000000001037, 37.44331775669783, 96.453843798908551, false },
+    { GBAPY_LINE, 200.38115077007674, 2511.8814008613035, 173.56155402397934, 2508.8475775212614, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 173.56155402397934, 2508.8475775212614, 173.38116561106506, 2508.7596149223964, 173.5952748573232, 2508.5494787030843, 0.29999999999998705, 96.453843798908551, 135.53655498992902, false },
+    { GBAPY_LINE, 173.38116561106506, 2508.7596149223964, 137.67959886363326, 2472.3830418044831, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 137.67959886363326, 2472.3830418044831, 137.59445244814705, 2472.1517857150498, 137.89370810989141, 2472.1729055851711, 0.29999999999999261, 135.53655498992902, 184.03693734407628, false },
+    { GBAPY_LINE, 137.59445244814705, 2472.1517857150498, 139.51659793478561, 2444.9161580209534, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 139.51659793478561, 2444.9161580209534, 139.53474750147987, 2444.8324954339282, 139.81585359652996, 2444.9372778910747, 0.29999999999996518, 184.03693734407628, 200.44296855978826, false },
+    { GBAPY_LINE, 139.53474750147987, 2444.8324954339282, 162.1947803852876, 2384.0410850095845, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 162.1947803852876, 2384.0410850095845, 180.68309460031938, 2338.0519435341125, 171.51437763563951, 2361.234036213596, 24.783549148391728, 112.22629641261166, 291.57922303445753, false },
+    { GBAPY_LINE, 180.68309460031938, 2338.0519435341125, 210.45459239505223, 2352.3973773205857, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 210.45459239505223, 2352.3973773205857, 235.37108983585387, 2336.6160765295513, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 235.37108983585387, 2336.6160765295513, 235.64596296618865, 2336.5921669743029, 235.53161164841578, 2336.8695183329141, 0.29999999999988791, 237.65115753884064, 292.4062396398927, false },
+    { GBAPY_LINE, 235.64596296618865, 2336.5921669743029, 258.3439351814547, 2345.9504879379447, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 258.3439351814547, 2345.9504879379447, 294.29402317617649, 2355.735292998776, 0, 0, 0, 0, 0, false },
+    { GBAPY_ARC, 294.29402317617649, 2355.735292998776, 294.50060038366701, 2356.1173217820233, 294.2152360897702, 2356.0247625049692, 0.30000000000010302, 285.22579568058109, 17.970719407705296, false },
+    { GBAPY_LINE, 294.50060038366701, 2356.1173217820233, 277.07728755908488, 2409.8341562234405, 0, 0, 0, 0, 0, false },
+    { GBAPY_LINE, 277.07728755908488, 2409.8341562234405, 301.09886661409638, 2449.3038572090154, 0, 0, 0, 0, 0, false },
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char *test, const char *what)
+{
+    if (ok) return;
+    fprintf(stderr, "%s: %s\n", test, what);
+    failures++;
+}
+
+static std::unique_ptr<PRIMITIVE> makePrimitive(const PRIMDATA &d)
+{
+    TERMINAL t1 = TERMINAL(d.x1, d.y1);
+    TERMINAL t2 = TERMINAL(d.x2, d.y2);
+    if (d.nKind == GBAPY_LINE) return std::make_unique<LINE>(t1, t2);
+    return std::make_unique<ARC>(TERMINAL(d.cx, d.cy), d.radius, d.startAngle, d.endAngle, t1, t2, d.clockWise);
+}
+
+static void makeShape(const PRIMDATA *data, std::size_t count, SHAPE *shp)
+{
+    shp->clear();
+    for (std::size_t i = 0; i < count; i++) {
+        shp->prims.push_back(makePrimitive(data[i]));
+    }
+    shp->update();
+}
+
+// The cross product test has to give the answer of the angle comparison
+// it replaced, at the ends of the arc and for sweeps close to 180 degrees.
+static void testArcContainment()
+{
+    static const double SWEEPS[] = { 0.001, 1, 90, 179.9999, 180, 180.0001, 179.35, 270, 359.999 };
+    static const double NEAR[] = { 0, 1E-7, 2E-6, 5E-6, 6E-6, 1E-5, 1E-4, 1E-3, 0.5 };
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> unit(0, 1);
+    int mismatches = 0;
+
+    for (int n = 0; n < 2000; n++) {
+        TERMINAL c = TERMINAL(2000 * unit(rng) - 1000, 2000 * unit(rng) - 1000);
+        double r = n % 3 == 0 ? 0.3 : 100 * unit(rng) + 0.01;
+        double sa = 360 * unit(rng);
+        bool cw = n % 2 == 0;
+        double sweep = n < 1000 ? SWEEPS[n % 9] : 360 * unit(rng);
+        double ea = std::fmod(sa + (cw ? 360 - sweep : sweep), 360);
+        ARC byAngle(c, r, sa, ea, cw);
+        ARC byEnds(c, byAngle.terms[0], byAngle.terms[1], cw);
+
+        const ARC *arcs[2] = { &byAngle, &byEnds };
+        for (int k = 0; k < 2; k++) {
+            const ARC *arc = arcs[k];
+            for (int e = 0; e < 2; e++) {
+                double end = e == 0 ? arc->startAngle : arc->endAngle;
+                for (int i = 0; i < 9; i++) {
+                    for (int s = -1; s <= 1; s += 2) {
+                        double a = (end + s * NEAR[i]) * M_PI / 180.0;
+                        TERMINAL p = TERMINAL(c.x + r * cos(a), c.y + r * sin(a));
+                        bool expected = std::abs(arc->radius - c.distanceTo(p)) <= EP
+                            && arc->isInsideAngle(c.angleTo(p));
+                        if (arc->isContainedPoint(p) != expected) mismatches++;
+                    }
+                }
+            }
+            for (int i = 0; i < 4; i++) {
+                double dx = i == 0 ? 1 : i == 2 ? -1 : 0;
+                double dy = i == 1 ? 1 : i == 3 ? -1 : 0;
+                if (arc->isInsideDirection(dx, dy) != arc->isInsideAngle(90.0 * i)) mismatches++;
+            }
+        }
+    }
+    check(mismatches == 0, "arc containment", "isContainedPoint() disagrees with isInsideAngle()");
+}
+
+// A shape an earlier containment test lost: after the first step its ray
+// casts graze the ends of the arcs, and it was taken for a negative one.
+static void testPolygonP400()
+{
+    SHAPE step;
+    makeShape(POLYGON_P400_STEP, sizeof(POLYGON_P400_STEP) / sizeof(PRIMDATA), &step);
+    check(step.isCompleted && step.isPositiveShape(), "polygon p400", "the first step is not a positive shape");
+
+    static const double DISTANCES[] = { 0.6, 1, 2, 3, 4 };
+    for (int i = 0; i < 5; i++) {
+        std::vector<SHAPE> shapes(1);
+        makeShape(POLYGON_P400, sizeof(POLYGON_P400) / sizeof(PRIMDATA), &shapes[0]);
+        check(shapes[0].isPositiveShape(), "polygon p400", "the polygon is not positive");
+        OffsetShapes(&shapes, DISTANCES[i]);
+        char what[64];
+        snprintf(what, sizeof(what), "offset %g gives %d shapes, not 1", DISTANCES[i], (int)shapes.size());
+        check(shapes.size() == 1, "polygon p400", what);
+    }
+}
+
+// A closed polygon around c through count corners, at radius inner on every
+// other one for a star, at radius outer on all of them for a convex one.
+static void makePolygon(TERMINAL c, double outer, double inner, int count, std::mt19937 *rng, SHAPE *shp)
+{
+    std::uniform_real_distribution<double> jitter(-0.3, 0.3);
+    std::vector<TERMINAL> corners;
+
+    for (int i = 0; i < count; i++) {
+        double a = (i + jitter(*rng)) * 2 * M_PI / count;
+        double r = i % 2 == 1 ? inner : outer;
+        corners.push_back(TERMINAL(c.x + r * cos(a), c.y + r * sin(a)));
+    }
+    shp->clear();
+    for (int i = 0; i < count; i++) {
+        shp->prims.push_back(std::make_unique<LINE>(corners[i], corners[(i + 1) % count]));
+    }
+    shp->update();
+}
+
+// The distance in ten fixed steps, the way every offset used to go.
+static void offsetInTenSteps(std::vector<SHAPE> *shapes, double r)
+{
+    BOOLEANENGINE engine;
+
+    for (int n = 0; n < 10; n++) {
+        std::vector<SHAPE> subShapes;
+        for (std::size_t i = 0; i < shapes->size(); i++) {
+            shapes->at(i).doOffsetOperation(r / 10.0, &subShapes);
+        }
+        if (subShapes.size() > 0) {
+            removeDuplicated(&subShapes);
+        }
+        for (std::size_t i = 0; i < subShapes.size(); i++) {
+            shapes->push_back(std::move(subShapes[i]));
+        }
+        subShapes.clear();
+        ClearShapes(shapes);
+        engine.execute(shapes);
+    }
+}
+
+// Bounding boxes of the shapes, sorted, as a summary to compare results by.
+static std::vector<double> getBoxes(std::vector<SHAPE> *shapes)
+{
+    std::vector<std::vector<double>> boxes;
+    for (std::size_t i = 0; i < shapes->size(); i++) {
+        TERMINAL mn, mx;
+        shapes->at(i).getBoundingBox(&mn, &mx);
+        boxes.push_back({ mn.x, mn.y, mx.x, mx.y });
+    }
+    std::sort(boxes.begin(), boxes.end());
+
+    std::vector<double> ret;
+    for (std::size_t i = 0; i < boxes.size(); i++) {
+        ret.insert(ret.end(), boxes[i].begin(), boxes[i].end());
+    }
+    return ret;
+}
+
+// Longer steps must end where the ten fixed ones do, on star polygons, which
+// keep to the fixed steps, and on convex ones, which may take longer steps
+// until they come close to each other.
+static void testOffsetSteps()
+{
+    std::mt19937 rng(14);
+    std::uniform_real_distribution<double> unit(0, 1);
+    int mismatches = 0;
+    int passes = 0;
+
+    for (int n = 0; n < 60; n++) {
+        bool convex = n % 3 != 0;
+        double gap = n % 2 == 0 ? 60 : 24;
+        std::vector<SHAPE> shapes(9);
+        for (int i = 0; i < 9; i++) {
+            TERMINAL c = TERMINAL(gap * (i % 3) + 4 * unit(rng), gap * (i / 3) + 4 * unit(rng));
+            double outer = 8 + 4 * unit(rng);
+            double inner = convex ? outer : outer * (0.3 + 0.5 * unit(rng));
+            makePolygon(c, outer, inner, 2 * (3 + (int)(6 * unit(rng))), &rng, &shapes[i]);
+        }
+        double r = (unit(rng) < 0.2 ? -3 : 12) * (0.2 + unit(rng));
+
+        std::vector<SHAPE> expected = shapes;
+        offsetInTenSteps(&expected, r);
+        int count = 0;
+        OffsetShapes(&shapes, r, [&](double, double) { count++; return true; });
+        if (convex && gap == 60 && r > 0) passes += count;
+
+        std::vector<double> a = getBoxes(&shapes);
+        std::vector<double> b = getBoxes(&expected);
+        bool same = a.size() == b.size();
+        for (std::size_t i = 0; same && i < a.size(); i++) {
+            same = std::abs(a[i] - b[i]) < 1E-6;
+        }
+        if (!same) mismatches++;
+    }
+    check(mismatches == 0, "offset steps", "longer steps end elsewhere than ten fixed ones");
+    check(passes > 0 && passes < 10 * 16, "offset steps", "convex shapes apart keep to the fixed steps");
+}
+
+// Scratch file for the shape file tests, in the working directory.
+static const char *TEST_FILE = "booleanoffset-test.shp";
+
+static std::vector<unsigned char> readBytes(const char *filePath)
+{
+    std::vector<unsigned char> ret;
+    FILE *pFile = fopen(filePath, "rb");
+    if (pFile == NULL) return ret;
+    int c;
+    while ((c = fgetc(pFile)) != EOF) ret.push_back((unsigned char)c);
+    fclose(pFile);
+    return ret;
+}
+
+static void writeBytes(const char *filePath, const std::vector<unsigned char> &bytes)
+{
+    FILE *pFile = fopen(filePath, "wb");
+    if (pFile == NULL) return;
+    fwrite(bytes.data(), 1, bytes.size(), pFile);
+    fclose(pFile);
+}
+
+// Whether both hold the same primitives, with ends to within tolerance.
+// Centres are only compared for exact copies, as the compact layout
+// rebuilds them from the bulge, which moves those of short arcs further.
+static bool isSameShapes(const std::vector<SHAPE> &a, const std::vector<SHAPE> &b, double tolerance)
+{
+    if (a.size() != b.size()) return false;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (a[i].prims.size() != b[i].prims.size()) return false;
+        for (std::size_t j = 0; j < a[i].prims.size(); j++) {
+            const PRIMITIVE *p = a[i].prims[j].get();
+            const PRIMITIVE *q = b[i].prims[j].get();
+            if (p->nKind != q->nKind) return false;
+            for (int k = 0; k < 2; k++) {
+                if (p->terms[k].distanceTo(q->terms[k]) > tolerance) return false;
+            }
+            if (p->nKind == GBAPY_ARC && tolerance == 0) {
+                if (p->clockWise != q->clockWise || p->radius != q->radius
+                    || p->center.distanceTo(q->center) > 0) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Both readers must turn the file down, the streamed one on open() or by
+// failing a read, rather than run out of memory on what it claims.
+static void checkRejected(const std::vector<unsigned char> &bytes, const char *what)
+{
+    writeBytes(TEST_FILE, bytes);
+
+    std::vector<SHAPE> shapes;
+    check(!ReadShapeFile(TEST_FILE, &shapes), "shape files", what);
+
+    SHAPEREADER reader;
+    bool rejected = !reader.open(TEST_FILE);
+    if (!rejected) {
+        SHAPE shp;
+        while (reader.read(&shp));
+        rejected = reader.isFailed();
+    }
+    check(rejected, "shape files", what);
+}
+
+// Every layout must read back what was written, whole and streamed, and
+// damaged counts and lengths must be rejected before they are allocated.
+static void testShapeFiles()
+{
+    std::mt19937 rng(24);
+    std::vector<SHAPE> shapes(3);
+    makeShape(POLYGON_P400, sizeof(POLYGON_P400) / sizeof(PRIMDATA), &shapes[0]);
+    makeShape(POLYGON_P400_STEP, sizeof(POLYGON_P400_STEP) / sizeof(PRIMDATA), &shapes[1]);
+    makePolygon(TERMINAL(-40, 25), 12, 5, 10, &rng, &shapes[2]);
+
+    static const int VERSIONS[] = { SHAPEFILE_LEGACY, SHAPEFILE_V2, SHAPEFILE_COMPACT };
+    for (int v = 0; v < 3; v++) {
+        // the compact layout snaps to its grid
+        double tolerance = VERSIONS[v] == SHAPEFILE_COMPACT ? 1E-5 : 0;
+        char what[64];
+
+        std::vector<SHAPE> read;
+        snprintf(what, sizeof(what), "version %d does not read back", VERSIONS[v]);
+        check(WriteShapeFile(TEST_FILE, &shapes, VERSIONS[v]) && ReadShapeFile(TEST_FILE, &read)
+            && isSameShapes(shapes, read, tolerance), "shape files", what);
+
+        SHAPEWRITER writer;
+        bool ok = writer.open(TEST_FILE, VERSIONS[v]);
+        for (std::size_t i = 0; ok && i < shapes.size(); i++) {
+            ok = writer.write(shapes[i]);
+        }
+        ok = writer.close() && ok;
+        SHAPEREADER reader;
+        std::vector<SHAPE> streamed;
+        ok = ok && reader.open(TEST_FILE) && reader.getCount() == shapes.size();
+        SHAPE shp;
+        while (ok && reader.read(&shp)) {
+            streamed.push_back(shp);
+        }
+        snprintf(what, sizeof(what), "version %d does not stream back", VERSIONS[v]);
+        check(ok && !reader.isFailed() && isSameShapes(shapes, streamed, tolerance), "shape files", what);
+    }
+
+    std::vector<unsigned char> bytes;
+    int count;
+
+    WriteShapeFile(TEST_FILE, &shapes, SHAPEFILE_LEGACY);
+    bytes = readBytes(TEST_FILE);
+    count = INT_MAX;
+    std::vector<unsigned char> legacy = bytes;
+    memcpy(legacy.data(), &count, sizeof(int));
+    checkRejected(legacy, "legacy file with a huge shape count");
+    legacy = bytes;
+    memcpy(legacy.data() + sizeof(int), &count, sizeof(int));
+    checkRejected(legacy, "legacy file with a huge primitive count");
+
+    WriteShapeFile(TEST_FILE, &shapes, SHAPEFILE_V2);
+    bytes = readBytes(TEST_FILE);
+    SHAPEFILEHEADER header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    std::uint64_t entry = (std::uint64_t)1 << 60;
+    memcpy(bytes.data() + header.tableOffset + sizeof(std::uint64_t), &entry, sizeof(entry));
+    checkRejected(bytes, "version 2 file with a huge table entry");
+
+    WriteShapeFile(TEST_FILE, &shapes, SHAPEFILE_COMPACT);
+    bytes = readBytes(TEST_FILE);
+    std::size_t end = sizeof(COMPACTHEADER);
+    while (bytes[end] & 0x80) end++;
+    static const unsigned char HUGE_LENGTH[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f };
+    bytes.erase(bytes.begin() + sizeof(COMPACTHEADER), bytes.begin() + end + 1);
+    bytes.insert(bytes.begin() + sizeof(COMPACTHEADER), HUGE_LENGTH, HUGE_LENGTH + sizeof(HUGE_LENGTH));
+    checkRejected(bytes, "compact file with a huge shape length");
+
+    remove(TEST_FILE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    if (filter == NULL || strstr("arc containment", filter) != NULL) testArcContainment();
+    if (filter == NULL || strstr("polygon p400", filter) != NULL) testPolygonP400();
+    if (filter == NULL || strstr("offset steps", filter) != NULL) testOffsetSteps();
+    if (filter == NULL || strstr("shape files", filter) != NULL) testShapeFiles();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
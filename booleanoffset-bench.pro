@@ -0,0 +1,10 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+TARGET = booleanoffset-bench
+
+include(engine.pri)
+
+SOURCES += \
+	Src/Bench/main.cpp
@@ -0,0 +1,10 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+TARGET = booleanoffset-cli
+
+include(engine.pri)
+
+SOURCES += \
+	Src/Cli/main.cpp
@@ -0,0 +1,10 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+TARGET = booleanoffset-gen
+
+include(engine.pri)
+
+SOURCES += \
+	Src/Gen/main.cpp
@@ -0,0 +1,10 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+TARGET = booleanoffset-test
+
+include(engine.pri)
+
+SOURCES += \
+	Src/Test/main.cpp
@@ -0,0 +1,41 @@
+HEADERS += \
+	$$PWD/Src/Engine/global.h \
+	$$PWD/Src/Engine/vertex.h \
+	$$PWD/Src/Engine/terminal.h \
+	$$PWD/Src/Engine/arena.h \
+	$$PWD/Src/Engine/budget.h \
+	$$PWD/Src/Engine/primitive.h \
+	$$PWD/Src/Engine/line.h \
+	$$PWD/Src/Engine/arc.h \
+	$$PWD/Src/Engine/primvalue.h \
+	$$PWD/Src/Engine/primarray.h \
+	$$PWD/Src/Engine/bvh.h \
+	$$PWD/Src/Engine/pointgrid.h \
+	$$PWD/Src/Engine/shape.h \
+	$$PWD/Src/Engine/shapefile.h \
+	$$PWD/Src/Engine/sweep.h \
+	$$PWD/Src/Engine/broadphase.h \
+	$$PWD/Src/Engine/boolean.h \
+	$$PWD/Src/Engine/offset.h \
+	$$PWD/Src/Engine/threadpool.h \
+	$$PWD/Src/Engine/core.h
+
+SOURCES += \
+	$$PWD/Src/Engine/vertex.cpp \
+	$$PWD/Src/Engine/terminal.cpp \
+	$$PWD/Src/Engine/arena.cpp \
+	$$PWD/Src/Engine/budget.cpp \
+	$$PWD/Src/Engine/primitive.cpp \
+	$$PWD/Src/Engine/line.cpp \
+	$$PWD/Src/Engine/arc.cpp \
+	$$PWD/Src/Engine/primvalue.cpp \
+	$$PWD/Src/Engine/primarray.cpp \
+	$$PWD/Src/Engine/bvh.cpp \
+	$$PWD/Src/Engine/pointgrid.cpp \
+	$$PWD/Src/Engine/shape.cpp \
+	$$PWD/Src/Engine/shapefile.cpp \
+	$$PWD/Src/Engine/sweep.cpp \
+	$$PWD/Src/Engine/broadphase.cpp \
+	$$PWD/Src/Engine/boolean.cpp \
+	$$PWD/Src/Engine/offset.cpp \
+	$$PWD/Src/Engine/threadpool.cpp